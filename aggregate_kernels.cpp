@@ -0,0 +1,74 @@
+// aggregate_kernels.cpp
+//
+// Implementation of the lazy-reduction aggregation kernel. The work is split
+// into one item per (tower, coefficient block), so it scales with cores and
+// memory bandwidth rather than with the number of shares.
+
+#include "aggregate_kernels.h"
+#include "parallel.h"
+#include <limits>
+
+uint64_t LazyAdditionBudget(uint64_t q) {
+    // A reduced running value r < q plus k inputs < q stays below 2^64 as
+    // long as (k + 1) * (q - 1) <= 2^64 - 1.
+    return std::numeric_limits<uint64_t>::max() / (q - 1) - 1;
+}
+
+/**
+ * @brief Sums polynomials with one reduction per LazyAdditionBudget inputs.
+ * @param polys The polynomials to sum (pointers, so shares are not copied).
+ * @param numThreads Threads to use; 0 means all cores.
+ * @return The sum, in the format and towers of the inputs.
+ */
+DCRTPoly SumPolynomials(const std::vector<const DCRTPoly*>& polys, int numThreads) {
+    if (polys.empty()) {
+        throw std::runtime_error("No polynomials to sum.");
+    }
+    const DCRTPoly& first = *polys[0];
+    const size_t numTowers = first.GetNumOfElements();
+    for (const DCRTPoly* poly : polys) {
+        if (poly->GetNumOfElements() != numTowers || poly->GetFormat() != first.GetFormat()) {
+            throw std::runtime_error("Cannot sum polynomials with different towers or formats.");
+        }
+    }
+
+    DCRTPoly result = first;
+    if (polys.size() == 1) {
+        return result;
+    }
+
+    const size_t ringDim = first.GetRingDimension();
+    const size_t blocksPerTower = (ringDim + AGGREGATE_BLOCK_SIZE - 1) / AGGREGATE_BLOCK_SIZE;
+    const int numItems = static_cast<int>(numTowers * blocksPerTower);
+
+    ParallelFor(numItems, ResolveThreadCount(numThreads), [&](int item) {
+        const size_t tower = item / blocksPerTower;
+        const size_t begin = (item % blocksPerTower) * AGGREGATE_BLOCK_SIZE;
+        const size_t end = std::min(ringDim, begin + AGGREGATE_BLOCK_SIZE);
+        const size_t n = end - begin;
+        NativePoly& out = result.ElementAtIndex(tower);
+        const uint64_t q = out.GetModulus().ConvertToInt();
+        const uint64_t budget = LazyAdditionBudget(q);
+
+        // The first input is already in `result`; start from it.
+        uint64_t acc[AGGREGATE_BLOCK_SIZE];
+        for (size_t j = 0; j < n; ++j) {
+            acc[j] = out[begin + j].ConvertToInt();
+        }
+        uint64_t pending = 0;
+        for (size_t p = 1; p < polys.size(); ++p) {
+            const NativePoly& in = polys[p]->GetElementAtIndex(tower);
+            for (size_t j = 0; j < n; ++j) {
+                acc[j] += in[begin + j].ConvertToInt();
+            }
+            if (++pending == budget) {
+                for (size_t j = 0; j < n; ++j) acc[j] %= q;
+                pending = 0;
+            }
+        }
+        for (size_t j = 0; j < n; ++j) {
+            out[begin + j] = NativeInteger(acc[j] % q);
+        }
+    });
+    return result;
+}
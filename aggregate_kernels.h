@@ -0,0 +1,28 @@
+// aggregate_kernels.h
+//
+// Header file for the server-side aggregation kernel. It sums many RNS
+// polynomials coefficient-wise with deferred modular reduction, in parallel
+// over (tower, coefficient block) pairs.
+
+#ifndef AGGREGATE_KERNELS_H
+#define AGGREGATE_KERNELS_H
+
+#include "common.h"
+
+// Coefficients per work item. 2^12 64-bit accumulators (32 KB) stay in L1
+// while every input streams through them once.
+const size_t AGGREGATE_BLOCK_SIZE = 1u << 12;
+
+// Number of values below q that can be added to a running value below q in a
+// 64-bit lane without overflow; the sum is reduced once per such group.
+// At least 15 for any modulus below 2^60.
+uint64_t LazyAdditionBudget(uint64_t q);
+
+// Returns Sum(polys) mod q, tower by tower. All inputs must be in the same
+// format and have the same towers. Instead of reducing after every addition,
+// each coefficient is reduced once per LazyAdditionBudget(q) inputs.
+// numThreads = 0 uses all cores. Throws std::runtime_error on an empty or
+// mismatched input.
+DCRTPoly SumPolynomials(const std::vector<const DCRTPoly*>& polys, int numThreads = 0);
+
+#endif // AGGREGATE_KERNELS_H
@@ -0,0 +1,391 @@
+// aggregation_tree.cpp
+//
+// Implementation of the hierarchical aggregation tree. Every aggregator is a
+// streaming accumulator per chunk; the share that completes a node's chunk
+// carries the node's partial sum up to its parent on the same thread, so the
+// levels overlap with the client phase just as they would on real machines.
+
+#include "aggregation_tree.h"
+#include "mk_ckks.h"
+#include "parallel.h"
+#include "noise_sampler.h"
+#include <sstream>
+#include <cstring>
+#include <csignal>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A simple timer utility.
+class Timer {
+public:
+    void Start() { m_StartTime = std::chrono::high_resolution_clock::now(); }
+    double Stop() {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(endTime - m_StartTime).count();
+    }
+private:
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_StartTime;
+};
+
+AggregationTree::AggregationTree(uint32_t numLeaves, uint32_t fanOut, uint32_t numChunks, uint32_t depth)
+    : m_numLeaves(numLeaves), m_fanOut(fanOut), m_numChunks(numChunks) {
+    if (numLeaves == 0 || numChunks == 0) {
+        throw std::invalid_argument("An aggregation tree needs at least one leaf and one chunk");
+    }
+    if (fanOut < 2) {
+        throw std::invalid_argument("An aggregation tree needs a fan-out of at least 2");
+    }
+    const uint32_t minDepth = DepthFor(numLeaves, fanOut);
+    if (depth == 0) depth = minDepth;
+    if (depth < minDepth) {
+        throw std::invalid_argument("Fan-out " + std::to_string(fanOut) + " needs depth " + std::to_string(minDepth) +
+                                    " for " + std::to_string(numLeaves) + " leaves, got " + std::to_string(depth));
+    }
+
+    uint32_t children = numLeaves;
+    for (uint32_t level = 1; level <= depth; ++level) {
+        const uint32_t nodes = (children + fanOut - 1) / fanOut;
+        std::vector<std::unique_ptr<Node>> row;
+        for (uint32_t k = 0; k < nodes; ++k) {
+            auto node = std::make_unique<Node>();
+            node->expectedChildren = std::min(fanOut, children - k * fanOut);
+            node->accumulators.resize(numChunks);
+            node->received.assign(numChunks, 0);
+            row.push_back(std::move(node));
+        }
+        m_levels.push_back(std::move(row));
+        children = nodes;
+    }
+    start();
+}
+
+uint32_t AggregationTree::DepthFor(uint32_t numLeaves, uint32_t fanOut) {
+    uint32_t depth = 1;
+    for (uint64_t reach = fanOut; reach < numLeaves; reach *= fanOut) ++depth;
+    return depth;
+}
+
+uint32_t AggregationTree::FanOutFor(uint32_t numLeaves, uint32_t depth) {
+    uint32_t fanOut = std::max<uint32_t>(2, static_cast<uint32_t>(std::ceil(std::pow(numLeaves, 1.0 / depth))));
+    // Correct pow() rounding in either direction.
+    while (fanOut > 2 && DepthFor(numLeaves, fanOut - 1) <= depth) --fanOut;
+    while (DepthFor(numLeaves, fanOut) > depth) ++fanOut;
+    return fanOut;
+}
+
+void AggregationTree::start() {
+    m_start = std::chrono::high_resolution_clock::now();
+}
+
+double AggregationTree::elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_start).count();
+}
+
+void AggregationTree::collectShare(uint32_t leaf, const ClientShare& share) {
+    if (leaf >= m_numLeaves) {
+        throw std::out_of_range("Leaf " + std::to_string(leaf) + " but the tree has " +
+                                std::to_string(m_numLeaves) + " leaves");
+    }
+    fold(1, leaf / m_fanOut, share);
+}
+
+void AggregationTree::collectPartial(uint32_t level, uint32_t node, const ClientShare& partial) {
+    if (level == 0 || level >= getDepth() || node >= getNumNodes(level)) {
+        throw std::out_of_range("No node " + std::to_string(node) + " below the root at level " + std::to_string(level));
+    }
+    fold(level + 1, node / m_fanOut, partial);
+}
+
+void AggregationTree::fold(uint32_t level, uint32_t node, const ClientShare& share) {
+    if (share.chunkIndex >= m_numChunks) {
+        throw std::out_of_range("Share for chunk " + std::to_string(share.chunkIndex) +
+                                " but the tree aggregates " + std::to_string(m_numChunks));
+    }
+    Node& state = *m_levels[level - 1][node];
+    const uint32_t chunk = share.chunkIndex;
+    ClientShare partial;
+    bool forward = false;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        Timer timer;
+        timer.Start();
+        // As in Server: only Sum(c0_i) + Sum(d_masked_i) is ever needed.
+        if (state.received[chunk] == 0) {
+            state.accumulators[chunk] = share.c0;
+        } else {
+            state.accumulators[chunk] += share.c0;
+        }
+        if (share.format == ShareFormat::SPLIT) {
+            state.accumulators[chunk] += share.d_masked;
+        }
+        state.foldMs += timer.Stop();
+
+        if (++state.received[chunk] == state.expectedChildren) {
+            if (++state.chunksDone == m_numChunks) state.completeMs = elapsedMs();
+            // The root keeps its sums; every other node hands its partial up.
+            if (level < getDepth()) {
+                partial.c0 = std::move(state.accumulators[chunk]);
+                partial.format = ShareFormat::COMPACT;
+                partial.chunkIndex = chunk;
+                forward = true;
+            }
+        }
+    }
+    if (forward) {
+        fold(level + 1, node / m_fanOut, partial);
+    }
+}
+
+const AggregationTree::Node& AggregationTree::expectRootComplete() const {
+    const Node& root = *m_levels.back()[0];
+    if (root.chunksDone != m_numChunks) {
+        throw std::runtime_error("The aggregation tree's root is still waiting for shares (" +
+                                 std::to_string(root.chunksDone) + " of " + std::to_string(m_numChunks) +
+                                 " chunks complete).");
+    }
+    return root;
+}
+
+std::vector<ClientShare> AggregationTree::getRootPartials() const {
+    const Node& root = expectRootComplete();
+    std::vector<ClientShare> partials(m_numChunks);
+    for (uint32_t c = 0; c < m_numChunks; ++c) {
+        partials[c].c0 = root.accumulators[c];
+        partials[c].format = ShareFormat::COMPACT;
+        partials[c].chunkIndex = c;
+    }
+    return partials;
+}
+
+ServerResult AggregationTree::getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize, SlotPacking packing) {
+    const Node& root = expectRootComplete();
+
+    ServerResult result;
+    for (const AggregationLevelTimings& level : getLevelTimings()) {
+        result.timings.t_aggregate_ms += level.foldMs;
+    }
+
+    // Every chunk decodes into its own slice of the result.
+    const uint32_t capacity = ChunkCapacity(cc, packing);
+    result.final_aggregated_vector.assign(dataSize, 0.0);
+    Timer timer;
+    timer.Start();
+    ParallelFor(static_cast<int>(m_numChunks), ResolveThreadCount(0), [&](int c) {
+        const uint32_t begin = std::min(dataSize, c * capacity);
+        const uint32_t length = std::min(capacity, dataSize - begin);
+        std::vector<double> values = Decode(root.accumulators[c], cc, length, packing);
+        std::copy(values.begin(), values.end(), result.final_aggregated_vector.begin() + begin);
+    });
+    result.timings.t_decode_ms = timer.Stop();
+    return result;
+}
+
+std::vector<AggregationLevelTimings> AggregationTree::getLevelTimings() const {
+    std::vector<AggregationLevelTimings> timings(m_levels.size());
+    for (size_t l = 0; l < m_levels.size(); ++l) {
+        timings[l].level = static_cast<uint32_t>(l + 1);
+        timings[l].numNodes = static_cast<uint32_t>(m_levels[l].size());
+        for (const auto& node : m_levels[l]) {
+            timings[l].foldMs += node->foldMs;
+            timings[l].completeMs = std::max(timings[l].completeMs, node->completeMs);
+        }
+        if (l < m_merged.size()) {
+            timings[l].foldMs += m_merged[l].foldMs;
+            timings[l].completeMs = std::max(timings[l].completeMs, m_merged[l].completeMs);
+        }
+    }
+    return timings;
+}
+
+void AggregationTree::mergeLevelTimings(const std::vector<AggregationLevelTimings>& subtree) {
+    if (m_merged.size() < subtree.size()) m_merged.resize(subtree.size());
+    for (size_t l = 0; l < subtree.size(); ++l) {
+        m_merged[l].foldMs += subtree[l].foldMs;
+        m_merged[l].completeMs = std::max(m_merged[l].completeMs, subtree[l].completeMs);
+    }
+}
+
+uint32_t AggregationTree::getNumLeaves() const {
+    return m_numLeaves;
+}
+
+uint32_t AggregationTree::getNumChunks() const {
+    return m_numChunks;
+}
+
+uint32_t AggregationTree::getFanOut() const {
+    return m_fanOut;
+}
+
+uint32_t AggregationTree::getDepth() const {
+    return static_cast<uint32_t>(m_levels.size());
+}
+
+uint32_t AggregationTree::getNumNodes(uint32_t level) const {
+    return static_cast<uint32_t>(m_levels.at(level - 1).size());
+}
+
+void AggregationTree::getLeafRange(uint32_t level, uint32_t node, uint32_t& first, uint32_t& count) const {
+    uint64_t span = 1;
+    for (uint32_t l = 0; l < level; ++l) span = std::min<uint64_t>(span * m_fanOut, m_numLeaves);
+    first = static_cast<uint32_t>(std::min<uint64_t>(node * span, m_numLeaves));
+    count = static_cast<uint32_t>(std::min<uint64_t>(span, m_numLeaves - first));
+}
+
+// =================================================================================
+// SUBTREES AS PROCESSES
+// =================================================================================
+// Each child writes one length-prefixed message to its pipe: the level timings,
+// the root partial of every chunk (OpenFHE binary serialization) and the
+// caller's blob.
+
+namespace {
+
+void WriteAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0) throw std::runtime_error("Failed to write to the aggregation pipe");
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void ReadAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0) throw std::runtime_error("Aggregation subprocess exited before sending its result");
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void WriteString(int fd, const std::string& s) {
+    uint64_t size = s.size();
+    WriteAll(fd, &size, sizeof(size));
+    WriteAll(fd, s.data(), s.size());
+}
+
+std::string ReadString(int fd) {
+    uint64_t size = 0;
+    ReadAll(fd, &size, sizeof(size));
+    std::string s(size, '\0');
+    ReadAll(fd, &s[0], size);
+    return s;
+}
+
+} // namespace
+
+void RunSubtreesInProcesses(AggregationTree& tree,
+                            const std::function<std::string(uint32_t, AggregationTree&)>& simulate,
+                            const std::function<void(uint32_t, const std::string&)>& onResult) {
+    const uint32_t depth = tree.getDepth();
+    if (depth < 2) {
+        throw std::invalid_argument("Subtree processes need an aggregation tree of depth 2 or more");
+    }
+    const uint32_t subtreeLevel = depth - 1;
+    const uint32_t numSubtrees = tree.getNumNodes(subtreeLevel);
+
+    std::vector<pid_t> children(numSubtrees);
+    std::vector<int> pipes(numSubtrees);
+    // Kills and reaps the `started` children so far, then throws: used when
+    // the next pipe or process cannot be created.
+    auto abandon = [&](uint32_t started, const std::string& what) {
+        for (uint32_t j = 0; j < started; ++j) {
+            close(pipes[j]);
+            kill(children[j], SIGKILL);
+            waitpid(children[j], nullptr, 0);
+        }
+        throw std::runtime_error(what);
+    };
+    std::cout.flush();
+    std::cerr.flush();
+    for (uint32_t k = 0; k < numSubtrees; ++k) {
+        int fds[2];
+        if (pipe(fds) != 0) abandon(k, "Failed to create an aggregation pipe");
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            abandon(k, "Failed to fork an aggregation subprocess");
+        }
+        if (pid == 0) {
+            // Child: one thread only. The parent's OpenMP thread pool does not
+            // survive fork(), so no parallel region may try to use it.
+            close(fds[0]);
+            for (uint32_t j = 0; j < k; ++j) close(pipes[j]);
+#ifdef _OPENMP
+            omp_set_num_threads(1);
+#endif
+            // The Gaussian sampler's state was copied from the parent, so every
+            // child would otherwise draw the same encryption noise.
+            UsePrgGaussianSampler();
+            int status = 0;
+            try {
+                uint32_t first, count;
+                tree.getLeafRange(subtreeLevel, k, first, count);
+                AggregationTree subtree(count, tree.getFanOut(), tree.getNumChunks(), subtreeLevel);
+                std::string blob = simulate(k, subtree);
+
+                std::vector<AggregationLevelTimings> timings = subtree.getLevelTimings();
+                std::vector<ClientShare> partials = subtree.getRootPartials();
+                uint64_t numTimings = timings.size(), numPartials = partials.size();
+                WriteAll(fds[1], &numTimings, sizeof(numTimings));
+                WriteAll(fds[1], timings.data(), numTimings * sizeof(AggregationLevelTimings));
+                WriteAll(fds[1], &numPartials, sizeof(numPartials));
+                for (const ClientShare& partial : partials) {
+                    std::stringstream ss;
+                    Serial::Serialize(partial.c0, ss, SerType::BINARY);
+                    WriteAll(fds[1], &partial.chunkIndex, sizeof(partial.chunkIndex));
+                    WriteString(fds[1], ss.str());
+                }
+                WriteString(fds[1], blob);
+            } catch (const std::exception& e) {
+                std::cerr << "Aggregation subprocess " << k << " failed: " << e.what() << std::endl;
+                status = 1;
+            }
+            close(fds[1]);
+            _exit(status);
+        }
+        close(fds[1]);
+        children[k] = pid;
+        pipes[k] = fds[0];
+    }
+
+    // Parent: the root only ever sees one partial per subtree.
+    std::string failure;
+    for (uint32_t k = 0; k < numSubtrees; ++k) {
+        try {
+            uint64_t numTimings = 0, numPartials = 0;
+            ReadAll(pipes[k], &numTimings, sizeof(numTimings));
+            std::vector<AggregationLevelTimings> timings(numTimings);
+            ReadAll(pipes[k], timings.data(), numTimings * sizeof(AggregationLevelTimings));
+            tree.mergeLevelTimings(timings);
+            ReadAll(pipes[k], &numPartials, sizeof(numPartials));
+            for (uint64_t c = 0; c < numPartials; ++c) {
+                ClientShare partial;
+                ReadAll(pipes[k], &partial.chunkIndex, sizeof(partial.chunkIndex));
+                std::stringstream ss(ReadString(pipes[k]));
+                Serial::Deserialize(partial.c0, ss, SerType::BINARY);
+                partial.format = ShareFormat::COMPACT;
+                tree.collectPartial(subtreeLevel, k, partial);
+            }
+            onResult(k, ReadString(pipes[k]));
+        } catch (const std::exception& e) {
+            if (failure.empty()) failure = "subtree " + std::to_string(k) + ": " + e.what();
+        }
+        close(pipes[k]);
+    }
+    for (pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && failure.empty()) {
+            failure = "a subprocess exited with an error";
+        }
+    }
+    if (!failure.empty()) {
+        throw std::runtime_error("Aggregation subtree processes failed: " + failure);
+    }
+}
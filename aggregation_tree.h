@@ -0,0 +1,108 @@
+// aggregation_tree.h
+//
+// Header file for the hierarchical aggregation topology. Instead of one flat
+// Server receiving every share, intermediate aggregators each sum the shares
+// of up to fanOut children and forward a single partial share to their
+// parent, until the root holds Sum(c0_i + d_masked_i) for the whole cohort.
+// Partial sums are still masked: the pairwise masks only cancel in the total.
+
+#ifndef AGGREGATION_TREE_H
+#define AGGREGATION_TREE_H
+
+#include "common.h"
+#include <functional>
+#include <mutex>
+
+// Timings of one tree level. Level 1 receives the client shares; the root is
+// level getDepth().
+struct AggregationLevelTimings {
+    uint32_t level{0};
+    uint32_t numNodes{0};
+    double foldMs{0.0};     // Time spent summing at this level, over all its nodes.
+    double completeMs{0.0}; // Wall time from start() until the level's last node finished.
+};
+
+class AggregationTree {
+public:
+    // A tree over numLeaves clients in which every aggregator has at most
+    // fanOut children. depth = 0 picks the smallest depth that reaches a
+    // single root (DepthFor); a larger depth adds pass-through levels.
+    // Throws std::invalid_argument if fanOut < 2 or depth is too small.
+    AggregationTree(uint32_t numLeaves, uint32_t fanOut, uint32_t numChunks = 1, uint32_t depth = 0);
+
+    // Smallest depth with fanOut^depth >= numLeaves, and the smallest fan-out
+    // that covers numLeaves in `depth` levels.
+    static uint32_t DepthFor(uint32_t numLeaves, uint32_t fanOut);
+    static uint32_t FanOutFor(uint32_t numLeaves, uint32_t depth);
+
+    // Restarts the clock that completion times are measured from.
+    void start();
+
+    // Delivers client `leaf`'s share to its level-1 aggregator. Thread-safe.
+    // An aggregator that has heard from all its children forwards its partial
+    // share (COMPACT format) to its parent on the calling thread.
+    void collectShare(uint32_t leaf, const ClientShare& share);
+
+    // Delivers the finished partial share of node `node` at `level` to its
+    // parent, e.g. one computed by a subtree in another process. Thread-safe.
+    void collectPartial(uint32_t level, uint32_t node, const ClientShare& partial);
+
+    // The root's per-chunk sums as COMPACT shares (for a subtree run elsewhere).
+    // Throws if the root has not heard from all its children.
+    std::vector<ClientShare> getRootPartials() const;
+
+    // Decodes the root's sums, like Server::getFinalResult. t_aggregate_ms is
+    // the summing time over all levels.
+    ServerResult getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize,
+                                SlotPacking packing = SlotPacking::REAL);
+
+    std::vector<AggregationLevelTimings> getLevelTimings() const;
+    // Folds in the level timings of a subtree that ran elsewhere (times add up,
+    // completion is the later of both).
+    void mergeLevelTimings(const std::vector<AggregationLevelTimings>& subtree);
+
+    uint32_t getNumLeaves() const;
+    uint32_t getNumChunks() const;
+    uint32_t getFanOut() const;
+    uint32_t getDepth() const;
+    uint32_t getNumNodes(uint32_t level) const;
+    // Leaves [first, first + count) below node `node` of `level`.
+    void getLeafRange(uint32_t level, uint32_t node, uint32_t& first, uint32_t& count) const;
+
+private:
+    struct Node {
+        std::mutex mutex;
+        uint32_t expectedChildren{0};
+        std::vector<DCRTPoly> accumulators; // One running sum per chunk.
+        std::vector<uint32_t> received;     // Children heard from, per chunk.
+        uint32_t chunksDone{0};
+        double foldMs{0.0};
+        double completeMs{-1.0};
+    };
+
+    // Folds `share` into node `node` of `level` and forwards it upward once complete.
+    void fold(uint32_t level, uint32_t node, const ClientShare& share);
+    // The root node; throws std::runtime_error while any of its chunks is incomplete.
+    const Node& expectRootComplete() const;
+    double elapsedMs() const;
+
+    uint32_t m_numLeaves;
+    uint32_t m_fanOut;
+    uint32_t m_numChunks;
+    std::vector<std::vector<std::unique_ptr<Node>>> m_levels; // m_levels[l - 1] = level l.
+    std::vector<AggregationLevelTimings> m_merged;           // From mergeLevelTimings.
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_start;
+};
+
+// Runs every subtree below the root in its own forked process (requires depth >= 2).
+// In the child, simulate(k, subtree) must feed every leaf of subtree k into
+// `subtree` (leaf ids relative to the subtree's first leaf, see getLeafRange);
+// it runs single-threaded. The subtree's root partials and level timings are
+// piped back and folded into `tree`'s root, and the string simulate returned
+// is handed to onResult(k, blob) in the parent. Throws std::runtime_error if a
+// child fails.
+void RunSubtreesInProcesses(AggregationTree& tree,
+                            const std::function<std::string(uint32_t, AggregationTree&)>& simulate,
+                            const std::function<void(uint32_t, const std::string&)>& onResult);
+
+#endif // AGGREGATION_TREE_H
@@ -0,0 +1,739 @@
+// benchmarks.cpp
+//
+// Implementation of the kernel self-checks and microbenchmarks. These are run
+// from the harness with a command-line flag (see main.cpp) and are independent
+// of the CSV experiment logs.
+
+#include "benchmarks.h"
+#include "reduce_kernels.h"
+#include "masking.h"
+#include "noise_sampler.h"
+#include "mk_ckks.h"
+#include "aggregate_kernels.h"
+#include "server.h"
+#include "share_wire.h"
+#include "pack_kernels.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+
+// A simple timer utility.
+class Timer {
+public:
+    void Start() { m_StartTime = std::chrono::high_resolution_clock::now(); }
+    double Stop() {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(endTime - m_StartTime).count();
+    }
+private:
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_StartTime;
+};
+
+// Keeps the optimizer from discarding a benchmarked result.
+static volatile uint64_t g_sink = 0;
+
+static uint64_t Checksum(const std::vector<uint64_t>& v) {
+    uint64_t acc = 0;
+    for (uint64_t x : v) acc ^= x;
+    return acc;
+}
+
+int RunReduceBenchmark() {
+    std::cout << "--- Keystream reduction kernels (active: "
+              << ReduceKernelName(GetActiveReduceKernel()) << ") ---" << std::endl;
+
+    // Moduli of the sizes produced by GenCryptoContext, plus edge cases.
+    const std::vector<uint64_t> moduli = {
+        (1ULL << 60) - 93, (1ULL << 50) - 27, (1ULL << 59) - 55, 0xFFFFFFFFFFFFFFC5ULL, 3ULL
+    };
+
+    // 1. Correctness: the dispatched kernel must match the scalar reference
+    // exactly, including odd lengths that exercise the scalar tail.
+    std::mt19937_64 gen(2024);
+    for (uint64_t q : moduli) {
+        for (size_t n : {size_t(1), size_t(7), size_t(4099)}) {
+            std::vector<uint64_t> in(n), expected(n), actual(n);
+            for (auto& x : in) x = gen();
+            in[0] = ~0ULL;
+            ReduceKeystreamScalar(in.data(), expected.data(), n, q);
+            ReduceKeystream(in.data(), actual.data(), n, q);
+            for (size_t i = 0; i < n; ++i) {
+                if (expected[i] != actual[i] || actual[i] >= q) {
+                    std::cerr << "❌ Mismatch for q=" << q << " at index " << i << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    std::cout << "✅ SIMD kernel matches the scalar reference." << std::endl;
+
+    // 2. Throughput on one ring's worth of words (N = 131072, 3 towers).
+    const size_t n = 131072 * 3;
+    const int reps = 50;
+    const uint64_t q = moduli[0];
+    std::vector<uint64_t> in(n), out(n);
+    for (auto& x : in) x = gen();
+
+    Timer timer;
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        for (size_t i = 0; i < n; ++i) out[i] = in[i] % q;
+        g_sink ^= Checksum(out);
+    }
+    double t_mod = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        ReduceKeystreamScalar(in.data(), out.data(), n, q);
+        g_sink ^= Checksum(out);
+    }
+    double t_scalar = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        ReduceKeystream(in.data(), out.data(), n, q);
+        g_sink ^= Checksum(out);
+    }
+    double t_simd = timer.Stop() / reps;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "  x % q           : " << t_mod << " ms\n"
+              << "  multiply-shift  : " << t_scalar << " ms\n"
+              << "  dispatched SIMD : " << t_simd << " ms (" << (t_mod / t_simd) << "x vs. %)" << std::endl;
+    return 0;
+}
+
+int RunECDHBenchmark(int numPeers) {
+    std::cout << "--- ECDH for one client against " << numPeers << " peers ---" << std::endl;
+
+    std::vector<SafePKey> keys;
+    std::map<uint32_t, ECDHPublicKey> allPublicKeys;
+    for (int i = 0; i <= numPeers; ++i) {
+        keys.push_back(GenerateECDHKeys());
+        allPublicKeys[i] = SerializePublicKey(keys.back());
+    }
+    const uint32_t myId = 0;
+
+    // 1. Per-call path: parse the DER key and build a fresh context for every peer.
+    Timer timer;
+    timer.Start();
+    std::vector<std::vector<unsigned char>> legacy;
+    for (const auto& pair : allPublicKeys) {
+        if (pair.first == myId) continue;
+        SafePKey peerPubKey = DeserializePublicKey(pair.second);
+        legacy.push_back(ComputeSharedSecret(keys[myId], peerPubKey));
+    }
+    double t_legacy = timer.Stop();
+
+    // 2. Directory path: parse once (a one-time, per-cohort cost shared by all
+    // clients), then derive with one reused context.
+    timer.Start();
+    PeerKeyDirectory peerKeys(allPublicKeys);
+    double t_parse = timer.Stop();
+
+    timer.Start();
+    std::vector<PairwiseSecret> secrets = ComputePairwiseSecrets(myId, keys[myId], peerKeys, 1);
+    double t_directory = timer.Stop();
+
+    if (secrets.size() != legacy.size()) {
+        std::cerr << "❌ Secret count mismatch" << std::endl;
+        return 1;
+    }
+    for (size_t k = 0; k < secrets.size(); ++k) {
+        if (secrets[k].secret != legacy[k]) {
+            std::cerr << "❌ Secret mismatch for peer " << secrets[k].peerId << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "✅ Directory secrets match the per-call path." << std::endl;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "  per-call parse + context : " << t_legacy << " ms\n"
+              << "  directory (derive only)  : " << t_directory << " ms ("
+              << (t_legacy / t_directory) << "x)\n"
+              << "  one-time directory parse : " << t_parse << " ms (amortized over all clients)" << std::endl;
+    return 0;
+}
+
+int RunMaskGraphVerifier(int numClients, int degree) {
+    std::cout << "--- Masking graph: n=" << numClients << ", k=" << degree << " ---" << std::endl;
+
+    // A small but valid CKKS context; only its element parameters matter here.
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(16384);
+    parameters.SetMultiplicativeDepth(1);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(8);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    auto params = cc->GetCryptoParameters()->GetElementParams();
+
+    std::vector<SafePKey> keys;
+    std::map<uint32_t, ECDHPublicKey> allPublicKeys;
+    for (int i = 0; i < numClients; ++i) {
+        keys.push_back(GenerateECDHKeys());
+        allPublicKeys[i] = SerializePublicKey(keys.back());
+    }
+    PeerKeyDirectory peerKeys(allPublicKeys);
+    MaskingGraph graph = MaskingGraph::KRegular(numClients, degree, 0x5ECA66ULL);
+
+    // 1. Structure: every client has exactly degree() neighbours and every edge
+    // is present in both directions (so each p_ij is added once and subtracted once).
+    for (int i = 0; i < numClients; ++i) {
+        std::vector<uint32_t> mine = graph.neighbours(i);
+        if (mine.size() != graph.degree()) {
+            std::cerr << "❌ Client " << i << " has " << mine.size() << " neighbours" << std::endl;
+            return 1;
+        }
+        for (uint32_t j : mine) {
+            std::vector<uint32_t> theirs = graph.neighbours(j);
+            if (j == static_cast<uint32_t>(i) || !std::binary_search(theirs.begin(), theirs.end(), static_cast<uint32_t>(i))) {
+                std::cerr << "❌ Edge " << i << " - " << j << " is not symmetric" << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "✅ Graph is " << graph.degree() << "-regular and symmetric." << std::endl;
+
+    // 2. Cancellation: fold every client's mask into one polynomial.
+    DCRTPoly sum_of_masks(params, Format::EVALUATION, true);
+    for (int i = 0; i < numClients; ++i) {
+        ApplyMask(i, keys[i], peerKeys, graph.neighbours(i), sum_of_masks);
+    }
+    for (size_t t = 0; t < sum_of_masks.GetNumOfElements(); ++t) {
+        const NativeVector& values = sum_of_masks.GetElementAtIndex(t).GetValues();
+        for (size_t j = 0; j < values.GetLength(); ++j) {
+            if (values[j].ConvertToInt() != 0) {
+                std::cerr << "❌ Masks do not cancel (tower " << t << ", coefficient " << j << ")" << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "✅ The sparse masks of all clients cancel to zero." << std::endl;
+
+    // 3. Cost of one client's mask: complete graph vs. k-regular graph.
+    Timer timer;
+    DCRTPoly mask(params, Format::EVALUATION, true);
+    timer.Start();
+    ApplyMask(0, keys[0], peerKeys, MaskingGraph::Complete(numClients).neighbours(0), mask, 1);
+    double t_complete = timer.Stop();
+    timer.Start();
+    ApplyMask(0, keys[0], peerKeys, graph.neighbours(0), mask, 1);
+    double t_sparse = timer.Stop();
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "  complete graph (" << numClients - 1 << " peers) : " << t_complete << " ms\n"
+              << "  k-regular graph (" << graph.degree() << " peers)  : " << t_sparse << " ms ("
+              << (t_complete / t_sparse) << "x)" << std::endl;
+    return 0;
+}
+
+int RunNoiseSamplerBenchmark() {
+    std::cout << "--- Noise samplers (centered binomial kernel: " << CenteredBinomialKernelName() << ") ---" << std::endl;
+
+    // 1. Correctness: the dispatched kernel must match the scalar reference and
+    // have variance eta / 2 (eta = 20 and 32 stand in for sigma = 3.19 and 4).
+    std::mt19937_64 gen(2024);
+    const size_t n = 1 << 20;
+    std::vector<uint64_t> random(n);
+    for (auto& x : random) x = gen();
+    for (uint32_t eta : {1u, 20u, 32u}) {
+        std::vector<int64_t> expected(n), actual(n);
+        SampleCenteredBinomialScalar(random.data(), expected.data(), n, eta);
+        SampleCenteredBinomial(random.data(), actual.data(), n, eta);
+        if (expected != actual) {
+            std::cerr << "❌ Kernel mismatch for eta=" << eta << std::endl;
+            return 1;
+        }
+        double mean = 0.0, var = 0.0;
+        for (int64_t x : actual) { mean += x; var += static_cast<double>(x) * x; }
+        mean /= n;
+        var = var / n - mean * mean;
+        if (std::abs(var - eta / 2.0) > 0.05 * eta || std::abs(mean) > 0.05) {
+            std::cerr << "❌ Wrong distribution for eta=" << eta << ": mean " << mean << ", variance " << var << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "✅ Centered binomial kernel matches the scalar reference and has variance eta/2." << std::endl;
+
+    // 2. One noise polynomial over a harness-sized ring (N = 2^17).
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(1 << 17);
+    parameters.SetMultiplicativeDepth(1);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(1 << 16);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(cc->GetCryptoParameters());
+    const double sigma = cryptoParams->GetDistributionParameter();
+    const int reps = 10;
+
+    const NoiseSamplerKind previous = GetNoiseSampler();
+    Timer timer;
+    double t_kind[2];
+    const NoiseSamplerKind kinds[2] = {NoiseSamplerKind::GAUSSIAN, NoiseSamplerKind::CENTERED_BINOMIAL};
+    for (int k = 0; k < 2; ++k) {
+        SetNoiseSampler(kinds[k]);
+        SampleNoise(cc, sigma); // Builds the cached per-context state.
+        timer.Start();
+        for (int r = 0; r < reps; ++r) {
+            DCRTPoly noise = SampleNoise(cc, sigma);
+            g_sink ^= noise.GetElementAtIndex(0).GetValues()[0].ConvertToInt();
+        }
+        t_kind[k] = timer.Stop() / reps;
+    }
+    SetNoiseSampler(previous);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "  Gaussian (OpenFHE)  : " << t_kind[0] << " ms per polynomial\n"
+              << "  Centered binomial   : " << t_kind[1] << " ms per polynomial ("
+              << (t_kind[0] / t_kind[1]) << "x)" << std::endl;
+    return 0;
+}
+
+int RunEncryptBenchmark() {
+    std::cout << "--- Encrypt: generic DCRTPoly path vs. fused prepared-key kernel ---" << std::endl;
+    const int reps = 10;
+    const double maxAbs = 10.0;
+
+    for (uint32_t logN : {14u, 15u, 16u, 17u}) {
+        CCParams<CryptoContextCKKSRNS> parameters;
+        parameters.SetRingDim(1 << logN);
+        parameters.SetMultiplicativeDepth(1);
+        parameters.SetScalingModSize(50);
+        parameters.SetBatchSize(1 << (logN - 1));
+        CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+        cc->Enable(PKE);
+
+        DCRTPoly crs = GenerateCRS(cc);
+        MKeyGenKeyPair keys = KeyGenSingle(cc, crs);
+        Timer timer;
+        timer.Start();
+        EncryptionContext ectx = PrepareEncryptionContext(cc, keys);
+        const double t_prepare = timer.Stop();
+
+        std::mt19937 gen(logN);
+        std::uniform_real_distribution<> distrib(-maxAbs, maxAbs);
+        std::vector<double> data(1u << (logN - 1));
+        for (auto& x : data) x = distrib(gen);
+        DCRTPoly m = encodeVector(cc, data);
+
+        // 1. Both paths must decrypt (c0 + d, single key) to the encoded data.
+        MKCiphertext generic = Encrypt(cc, keys.pk, keys.sk, m);
+        MKCiphertext fused = Encrypt(ectx, m);
+        for (const MKCiphertext* ct : {&generic, &fused}) {
+            std::vector<double> decoded = Decode(ct->c0 + ct->c1, cc, static_cast<uint32_t>(data.size()));
+            for (size_t i = 0; i < data.size(); ++i) {
+                if (std::abs(decoded[i] - data[i]) > 1e-3) {
+                    std::cerr << "❌ N=2^" << logN << ": slot " << i << " decodes to " << decoded[i]
+                              << ", expected " << data[i] << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+        // 2. Timings.
+        timer.Start();
+        for (int r = 0; r < reps; ++r) {
+            MKCiphertext ct = Encrypt(cc, keys.pk, keys.sk, m);
+            g_sink ^= ct.c1.GetElementAtIndex(0)[0].ConvertToInt();
+        }
+        const double t_generic = timer.Stop() / reps;
+        timer.Start();
+        for (int r = 0; r < reps; ++r) {
+            MKCiphertext ct = Encrypt(ectx, m);
+            g_sink ^= ct.c1.GetElementAtIndex(0)[0].ConvertToInt();
+        }
+        const double t_fused = timer.Stop() / reps;
+
+        // Analytical memory traffic, not measured: 64-bit words moved per
+        // (coefficient, tower) outside sampling and NTTs. The generic path makes
+        // seven 2-in/1-out passes (21); the fused one reads v, e*, e0, e1, m and
+        // six key operands and writes c0 and d (13).
+        const double wordsPerEncrypt = static_cast<double>(cc->GetRingDimension()) * ectx.towers.size();
+        const double mbGeneric = 21.0 * wordsPerEncrypt * sizeof(uint64_t) / (1 << 20);
+        const double mbFused = 13.0 * wordsPerEncrypt * sizeof(uint64_t) / (1 << 20);
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  N=2^" << logN << ", " << ectx.towers.size() << " towers: generic " << t_generic
+                  << " ms (est. " << mbGeneric << " MB moved), fused " << t_fused << " ms (est. " << mbFused
+                  << " MB moved), " << (t_generic / t_fused) << "x; key preparation " << t_prepare << " ms once"
+                  << std::endl;
+    }
+    std::cout << "✅ Fused and generic ciphertexts decrypt to the same data." << std::endl;
+    std::cout << "   (\"est. MB moved\" is an analytical count of 21 vs. 13 words per coefficient and tower,"
+              << " outside sampling and NTTs; only the timings are measured.)" << std::endl;
+    return 0;
+}
+
+int RunAggregateBenchmark() {
+    const int allThreads = ResolveThreadCount(0);
+    std::cout << "--- Server aggregation: sequential DCRTPoly += vs. lazy-reduction kernel ("
+              << allThreads << " threads) ---" << std::endl;
+
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(1 << 15);
+    parameters.SetMultiplicativeDepth(2);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(1 << 14);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+
+    // Uniform polynomials stand in for shares: every coefficient is a full residue.
+    std::vector<DCRTPoly> shares;
+    for (size_t numShares : {16u, 64u, 256u}) {
+        while (shares.size() < numShares) shares.push_back(GenerateCRS(cc));
+        std::vector<const DCRTPoly*> polys;
+        for (size_t i = 0; i < numShares; ++i) polys.push_back(&shares[i]);
+
+        Timer timer;
+        timer.Start();
+        DCRTPoly expected = shares[0];
+        for (size_t i = 1; i < numShares; ++i) expected += shares[i];
+        const double t_sequential = timer.Stop();
+
+        timer.Start();
+        DCRTPoly single = SumPolynomials(polys, 1);
+        const double t_single = timer.Stop();
+        timer.Start();
+        DCRTPoly parallel = SumPolynomials(polys, allThreads);
+        const double t_parallel = timer.Stop();
+
+        if (!(single == expected) || !(parallel == expected)) {
+            std::cerr << "❌ Lazy-reduction sum differs from the sequential sum for " << numShares
+                      << " shares" << std::endl;
+            return 1;
+        }
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << std::setw(3) << numShares << " shares x " << expected.GetNumOfElements()
+                  << " towers: sequential " << t_sequential << " ms, kernel 1 thread " << t_single
+                  << " ms (" << (t_sequential / t_single) << "x), kernel " << allThreads << " threads "
+                  << t_parallel << " ms (" << (t_sequential / t_parallel) << "x)" << std::endl;
+    }
+    std::cout << "✅ Lazy-reduction sums match the sequential sums." << std::endl;
+    return 0;
+}
+
+int RunIngestBenchmark(int numShares) {
+    const int maxThreads = ResolveThreadCount(0);
+    std::cout << "--- Server ingest: striped per-worker accumulators, " << numShares << " shares ---" << std::endl;
+
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(1 << 15);
+    parameters.SetMultiplicativeDepth(1);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(1 << 14);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    const uint32_t slots = 1 << 14;
+
+    // A pool of distinct uniform SPLIT shares, reused cyclically.
+    const int poolSize = 32;
+    std::vector<ClientShare> pool(poolSize);
+    for (ClientShare& share : pool) {
+        share.c0 = GenerateCRS(cc);
+        share.d_masked = GenerateCRS(cc);
+    }
+
+    std::vector<double> reference;
+    double t_single = 0.0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        Server server(AggregationMode::STREAMING, 1, threads);
+        Timer timer;
+        timer.Start();
+        ParallelFor(numShares, threads, [&](int i) {
+            server.collectShare(pool[i % poolSize], CurrentThreadIndex());
+        });
+        const double t_ingest = timer.Stop();
+
+        // 1. Every thread count must produce the same aggregate (decoding is deterministic).
+        ServerResult result = server.getFinalResult(cc, slots);
+        if (server.getNumShares() != static_cast<size_t>(numShares)) {
+            std::cerr << "❌ Server counted " << server.getNumShares() << " of " << numShares << " shares" << std::endl;
+            return 1;
+        }
+        if (threads == 1) {
+            reference = result.final_aggregated_vector;
+            t_single = t_ingest;
+        } else if (result.final_aggregated_vector != reference) {
+            std::cerr << "❌ Aggregate with " << threads << " workers differs from the single-worker aggregate" << std::endl;
+            return 1;
+        }
+
+        // 2. Throughput, and the tree merge that getFinalResult adds once per round.
+        std::cout << std::fixed << std::setprecision(1)
+                  << "  " << std::setw(3) << threads << " worker(s): " << (numShares * 1000.0 / t_ingest)
+                  << " shares/s (" << std::setprecision(2) << (t_single / t_ingest) << "x)" << std::endl;
+        // End on maxThreads even when it is not a power of two.
+        if (threads < maxThreads && threads * 2 > maxThreads) threads = maxThreads / 2;
+    }
+    std::cout << "✅ Striped ingest gives the same aggregate for every worker count." << std::endl;
+    return 0;
+}
+
+int RunWireFormatBenchmark() {
+    std::cout << "--- Share serialization: lbcrypto::Serial (cereal) vs. flat wire format ---" << std::endl;
+
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(1 << 15);
+    parameters.SetMultiplicativeDepth(2);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(1 << 14);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    auto params = cc->GetCryptoParameters()->GetElementParams();
+    const uint64_t contextId = WireContextId(cc);
+
+    ClientShare split;
+    split.c0 = GenerateCRS(cc);
+    split.d_masked = GenerateCRS(cc);
+    ClientShare compact;
+    compact.format = ShareFormat::COMPACT;
+    compact.c0 = split.c0 + split.d_masked;
+    compact.chunkIndex = 3;
+
+    // 1. Correctness: the flat format round-trips, sums in place, and maps from a file.
+    for (ShareEncoding encoding : {ShareEncoding::RAW64, ShareEncoding::PACKED})
+    for (const ClientShare* share : {&split, &compact}) {
+        std::vector<uint8_t> wire;
+        SerializeShareWire(*share, contextId, wire, encoding);
+        ShareWireView view(wire.data(), wire.size());
+        view.expectContext(contextId);
+        ClientShare decoded = DeserializeShareWire(view, params);
+        const bool splitShare = share->format == ShareFormat::SPLIT;
+        if (!(decoded.c0 == share->c0) || (splitShare && !(decoded.d_masked == share->d_masked)) ||
+            decoded.format != share->format || decoded.chunkIndex != share->chunkIndex) {
+            std::cerr << "❌ Wire round trip changed the share" << std::endl;
+            return 1;
+        }
+        DCRTPoly accumulator(params, Format::EVALUATION, true);
+        AccumulateShareWire(view, accumulator);
+        if (!(accumulator == compact.c0)) {
+            std::cerr << "❌ In-place wire sum differs from c0 + d_masked" << std::endl;
+            return 1;
+        }
+
+        const std::string path = (std::filesystem::temp_directory_path() / "secure_fl_share.bin").string();
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(wire.data()), wire.size());
+        {
+            MappedShareWire mapped(path);
+            if (!(DeserializeShareWire(mapped.view(), params).c0 == share->c0)) {
+                std::cerr << "❌ Memory-mapped share differs from the written share" << std::endl;
+                return 1;
+            }
+        }
+        std::filesystem::remove(path);
+    }
+    {
+        std::vector<uint8_t> wire;
+        SerializeShareWire(split, contextId + 1, wire);
+        bool rejected = false;
+        try {
+            ShareWireView(wire.data(), wire.size()).expectContext(contextId);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            std::cerr << "❌ Share from another context was accepted" << std::endl;
+            return 1;
+        }
+    }
+    {
+        // An unreduced coefficient is rejected on rebuild and reduced when summed in place.
+        std::vector<uint8_t> wire;
+        SerializeShareWire(compact, contextId, wire);
+        reinterpret_cast<uint64_t*>(wire.data() + sizeof(ShareWireHeader))[0] = ~0ULL;
+        ShareWireView view(wire.data(), wire.size());
+        bool rejected = false;
+        try {
+            DeserializeShareWire(view, params);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        DCRTPoly accumulator(params, Format::EVALUATION, true);
+        AccumulateShareWire(view, accumulator);
+        const NativePoly& tower = accumulator.GetElementAtIndex(0);
+        if (!rejected || tower[0].ConvertToInt() >= tower.GetModulus().ConvertToInt()) {
+            std::cerr << "❌ Share coefficient above its modulus was not rejected or reduced" << std::endl;
+            return 1;
+        }
+    }
+    {
+        // Swapping two towers' widths keeps the size but no longer fits the moduli.
+        std::vector<uint8_t> wire;
+        SerializeShareWire(compact, contextId, wire, ShareEncoding::PACKED);
+        uint8_t* widths = wire.data() + sizeof(ShareWireHeader);
+        std::swap(widths[0], widths[1]);
+        bool rejected = widths[0] == widths[1];
+        try {
+            DCRTPoly accumulator(params, Format::EVALUATION, true);
+            AccumulateShareWire(ShareWireView(wire.data(), wire.size()), accumulator);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        if (!rejected) {
+            std::cerr << "❌ Packed share with widths that do not fit its moduli was accepted" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "✅ Wire shares (64-bit and bit-packed) round-trip, sum in place and map from a file." << std::endl;
+
+    // 2. Throughput on one SPLIT share (MB/s of serialized share).
+    const int reps = 20;
+    Timer timer;
+    std::string cereal;
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        std::stringstream ss;
+        Serial::Serialize(split.c0, ss, SerType::BINARY);
+        Serial::Serialize(split.d_masked, ss, SerType::BINARY);
+        cereal = ss.str();
+    }
+    const double t_cereal_out = timer.Stop() / reps;
+
+    ClientShare parsed;
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        std::stringstream ss(cereal);
+        Serial::Deserialize(parsed.c0, ss, SerType::BINARY);
+        Serial::Deserialize(parsed.d_masked, ss, SerType::BINARY);
+    }
+    const double t_cereal_in = timer.Stop() / reps;
+
+    DCRTPoly accumulator(params, Format::EVALUATION, true);
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        std::stringstream ss(cereal);
+        Serial::Deserialize(parsed.c0, ss, SerType::BINARY);
+        Serial::Deserialize(parsed.d_masked, ss, SerType::BINARY);
+        accumulator += parsed.c0;
+        accumulator += parsed.d_masked;
+    }
+    const double t_cereal_sum = timer.Stop() / reps;
+
+    std::vector<uint8_t> wire;
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        SerializeShareWire(split, contextId, wire);
+    }
+    const double t_wire_out = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        parsed = DeserializeShareWire(ShareWireView(wire.data(), wire.size()), params);
+    }
+    const double t_wire_in = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        AccumulateShareWire(ShareWireView(wire.data(), wire.size()), accumulator);
+    }
+    const double t_wire_sum = timer.Stop() / reps;
+
+    std::vector<uint8_t> packed;
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        SerializeShareWire(split, contextId, packed, ShareEncoding::PACKED);
+    }
+    const double t_packed_out = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        parsed = DeserializeShareWire(ShareWireView(packed.data(), packed.size()), params);
+    }
+    const double t_packed_in = timer.Stop() / reps;
+
+    timer.Start();
+    for (int r = 0; r < reps; ++r) {
+        AccumulateShareWire(ShareWireView(packed.data(), packed.size()), accumulator);
+    }
+    const double t_packed_sum = timer.Stop() / reps;
+    g_sink = g_sink + accumulator.GetElementAtIndex(0)[0].ConvertToInt();
+
+    auto mbps = [](size_t bytes, double ms) { return bytes / (ms * 1000.0); };
+    std::cout << std::fixed << std::setprecision(1)
+              << "  SPLIT share, N=" << split.c0.GetRingDimension() << ", " << split.c0.GetNumOfElements()
+              << " towers: cereal " << cereal.size() << " bytes, wire " << wire.size() << " bytes, packed "
+              << packed.size() << " bytes\n"
+              << "    serialize:        cereal " << mbps(cereal.size(), t_cereal_out) << " MB/s, wire "
+              << mbps(wire.size(), t_wire_out) << " MB/s (" << std::setprecision(2) << (t_cereal_out / t_wire_out) << "x)\n"
+              << std::setprecision(1)
+              << "    deserialize:      cereal " << mbps(cereal.size(), t_cereal_in) << " MB/s, wire "
+              << mbps(wire.size(), t_wire_in) << " MB/s (" << std::setprecision(2) << (t_cereal_in / t_wire_in) << "x)\n"
+              << std::setprecision(1)
+              << "    receive + sum:    cereal " << mbps(cereal.size(), t_cereal_sum) << " MB/s, wire in place "
+              << mbps(wire.size(), t_wire_sum) << " MB/s (" << std::setprecision(2) << (t_cereal_sum / t_wire_sum) << "x)\n"
+              << std::setprecision(3)
+              << "    packed (ms/share): serialize " << t_packed_out << ", deserialize " << t_packed_in
+              << ", receive + sum " << t_packed_sum << " (wire: " << t_wire_out << ", " << t_wire_in << ", "
+              << t_wire_sum << ")" << std::endl;
+    return 0;
+}
+
+int RunPackBenchmark() {
+    std::cout << "--- Coefficient bit-packing kernels (active: "
+              << PackKernelName(GetActivePackKernel()) << ") ---" << std::endl;
+
+    // 1. Correctness: every width, with lengths that leave a short last group;
+    // the dispatched kernels must match the scalar layout and round-trip.
+    std::mt19937_64 gen(2025);
+    for (uint32_t width = 1; width <= 64; ++width) {
+        const uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+        for (size_t n : {size_t(1), size_t(255), size_t(256), size_t(4099)}) {
+            std::vector<uint64_t> in(n), expected(PackedWords(n, width)), actual(expected.size()), out(n);
+            for (auto& x : in) x = gen() & mask;
+            in[0] = mask;
+            PackBitsScalar(in.data(), n, width, expected.data());
+            PackBits(in.data(), n, width, actual.data());
+            if (actual != expected) {
+                std::cerr << "❌ Packed words differ from the scalar reference for width " << width << std::endl;
+                return 1;
+            }
+            UnpackBits(actual.data(), n, width, out.data());
+            if (out != in) {
+                std::cerr << "❌ Unpacking does not restore the values for width " << width << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "✅ SIMD pack/unpack match the scalar reference for widths 1-64." << std::endl;
+
+    // 2. Throughput on one ring's worth of coefficients (N = 131072, 3 towers).
+    const size_t n = 131072 * 3;
+    const int reps = 50;
+    for (uint32_t width : {50u, 60u}) {
+        std::vector<uint64_t> in(n), packed(PackedWords(n, width)), out(n);
+        for (auto& x : in) x = gen() >> (64 - width);
+
+        Timer timer;
+        timer.Start();
+        for (int r = 0; r < reps; ++r) PackBitsScalar(in.data(), n, width, packed.data());
+        const double t_pack_scalar = timer.Stop() / reps;
+        timer.Start();
+        for (int r = 0; r < reps; ++r) PackBits(in.data(), n, width, packed.data());
+        const double t_pack = timer.Stop() / reps;
+        timer.Start();
+        for (int r = 0; r < reps; ++r) UnpackBitsScalar(packed.data(), n, width, out.data());
+        const double t_unpack_scalar = timer.Stop() / reps;
+        timer.Start();
+        for (int r = 0; r < reps; ++r) UnpackBits(packed.data(), n, width, out.data());
+        const double t_unpack = timer.Stop() / reps;
+        g_sink = g_sink + Checksum(out);
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "  " << width << "-bit: " << (100.0 * width / 64) << "% of 64-bit size; pack scalar "
+                  << t_pack_scalar << " ms, SIMD " << t_pack << " ms (" << std::setprecision(2)
+                  << (t_pack_scalar / t_pack) << "x); unpack scalar " << std::setprecision(3) << t_unpack_scalar
+                  << " ms, SIMD " << t_unpack << " ms (" << std::setprecision(2) << (t_unpack_scalar / t_unpack)
+                  << "x)" << std::endl;
+    }
+    return 0;
+}
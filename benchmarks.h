@@ -0,0 +1,51 @@
+// benchmarks.h
+//
+// Header file for the kernel self-checks and microbenchmarks. Each entry point
+// verifies an optimized kernel against its reference implementation, prints
+// timings to the console, and returns 0 on success (non-zero on a mismatch) so
+// it can be used directly as the process exit code.
+
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+// Keystream reduction: `x % q` vs. scalar multiply-shift vs. the dispatched SIMD kernel.
+int RunReduceBenchmark();
+
+// ECDH for one client against every peer: per-call DER parse + fresh EVP context
+// vs. the pre-parsed PeerKeyDirectory with a reused derivation context.
+int RunECDHBenchmark(int numPeers = 500);
+
+// Sparse masking: checks that a k-regular MaskingGraph is symmetric and regular,
+// that the masks of all clients still sum to zero, and times one client's mask
+// against the complete graph.
+int RunMaskGraphVerifier(int numClients = 100, int degree = 8);
+
+// Noise sampling: checks the centered binomial kernel against its scalar
+// reference and its variance, then times one full-ring noise polynomial from
+// the OpenFHE Gaussian vs. the centered binomial sampler.
+int RunNoiseSamplerBenchmark();
+
+// Client encryption: checks that the fused prepared-key Encrypt and the generic
+// DCRTPoly Encrypt both decrypt to the data, then times both across ring sizes.
+int RunEncryptBenchmark();
+
+// Server aggregation: checks SumPolynomials against sequential DCRTPoly
+// additions and times both, single- and multi-threaded, for growing share counts.
+int RunAggregateBenchmark();
+
+// Server ingest: folds the same shares into a STREAMING server from 1, 2, 4, ...
+// worker threads, checks that every run yields the same aggregate, and reports
+// shares per second.
+int RunIngestBenchmark(int numShares = 512);
+
+// Share serialization: checks that the flat wire format (64-bit and bit-packed)
+// round-trips, sums in place, maps from a file and rejects a foreign context,
+// then compares its serialize, deserialize and receive-and-sum throughput with
+// lbcrypto::Serial.
+int RunWireFormatBenchmark();
+
+// Bit packing: checks the SIMD pack/unpack kernels against the scalar layout
+// for every width, then times both on a ring's worth of coefficients.
+int RunPackBenchmark();
+
+#endif // BENCHMARKS_H
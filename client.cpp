@@ -27,6 +27,8 @@ void Client::generateKeys(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a) {
     Timer timer;
     timer.Start();
     m_keys = KeyGenSingle(cc, crs_a);
+    // Prepared once here, reused by every encryption of every round.
+    m_encryptionContext = PrepareEncryptionContext(cc, m_keys);
     // Store the result in our new member variable.
     m_keyGenTimings.t_mkckks_ms = timer.Stop();
 
@@ -48,8 +50,35 @@ void Client::generateData(uint32_t dataSize, double minVal, double maxVal) {
     }
 }
 
+void Client::setShareFormat(ShareFormat format) {
+    m_shareFormat = format;
+}
+
+void Client::setSlotPacking(SlotPacking packing) {
+    m_slotPacking = packing;
+}
+
+void Client::setUploadTowers(uint32_t numTowers) {
+    m_uploadTowers = numTowers;
+}
+
+// In COMPACT format the client does the server's c0 + d_masked addition itself,
+// so only one polynomial goes over the wire. The sum reveals nothing beyond the
+// split share, since the server adds the two components anyway.
+void Client::packShare(MKCiphertext& ciphertext, ClientShare& share) const {
+    share.format = m_shareFormat;
+    if (m_shareFormat == ShareFormat::COMPACT) {
+        ciphertext.c0 += ciphertext.c1;
+        share.c0 = std::move(ciphertext.c0);
+        return;
+    }
+    share.c0 = std::move(ciphertext.c0);
+    share.d_masked = std::move(ciphertext.c1);
+}
+
 // This function implements the full client-side protocol for a single round.
-ClientResult Client::prepareShareForServer(CryptoContext<DCRTPoly>& cc, const std::map<uint32_t, ECDHPublicKey>& allPublicKeys) {
+ClientResult Client::prepareShareForServer(CryptoContext<DCRTPoly>& cc, const PeerKeyDirectory& peerKeys,
+                                           const MaskingGraph& graph) {
 
     ClientResult result;
     Timer timer;
@@ -62,20 +91,23 @@ ClientResult Client::prepareShareForServer(CryptoContext<DCRTPoly>& cc, const st
 
     // 1. Measure Encoding and Encryption.
     timer.Start();
-    DCRTPoly encoded_poly = encodeVector(cc, m_data);
-    MKCiphertext ciphertext = Encrypt(cc, m_keys.pk, m_keys.sk, encoded_poly);
+    DCRTPoly encoded_poly = encodeVector(cc, m_data, m_slotPacking);
+    // Only the towers the aggregate needs are computed; the mask below is then
+    // only expanded for those.
+    MKCiphertext ciphertext = Encrypt(m_encryptionContext, encoded_poly, m_uploadTowers);
     result.timings.t_encrypt_ms = timer.Stop();
 
 
     // 2. Measure Mask Generation Time.
+    // The mask is accumulated straight into the partial decryption share, so
+    // no separate mask polynomial is ever materialized.
     timer.Start();
-    DCRTPoly mask = GenerateMask(m_id, m_ecdhKeys, allPublicKeys, cc);
+    ApplyMask(m_id, m_ecdhKeys, peerKeys, graph.neighbours(m_id), ciphertext.c1);
     result.timings.t_mask_gen_ms = timer.Stop();
 
 
-    // 3. Apply the mask and create the final share.
-    result.share.c0 = ciphertext.c0;
-    result.share.d_masked = ciphertext.c1 + mask;
+    // 3. The masked share is now d + r_i.
+    packShare(ciphertext, result.share);
 
     // 4. Calculate total client-side time.
     result.timings.t_client_total_ms = result.timings.t_encrypt_ms + result.timings.t_mask_gen_ms;
@@ -83,6 +115,136 @@ ClientResult Client::prepareShareForServer(CryptoContext<DCRTPoly>& cc, const st
     return result;
 }
 
+// Tensor version of prepareShareForServer: one encryption and one chunk mask per chunk.
+ClientTimings Client::prepareTensorShares(CryptoContext<DCRTPoly>& cc, const PeerKeyDirectory& peerKeys,
+                                          const MaskingGraph& graph,
+                                          const std::function<void(ClientShare&)>& sink) {
+    ClientTimings timings;
+    timings.key_gen = m_keyGenTimings;
+    Timer timer;
+
+    // 1. One ECDH derivation per neighbour covers every chunk.
+    timer.Start();
+    std::vector<PairwiseSecret> secrets = ComputePairwiseSecrets(m_id, m_ecdhKeys, peerKeys, graph.neighbours(m_id));
+    timings.t_mask_gen_ms += timer.Stop();
+
+    const uint32_t dataSize = static_cast<uint32_t>(m_data.size());
+    const uint32_t capacity = ChunkCapacity(cc, m_slotPacking);
+    const uint32_t numChunks = NumChunks(dataSize, capacity);
+    for (uint32_t k = 0; k < numChunks; ++k) {
+        const uint32_t chunk = (m_id + k) % numChunks;
+        const uint32_t begin = chunk * capacity;
+        const uint32_t end = std::min(dataSize, begin + capacity);
+
+        // 2. Encode and encrypt this chunk.
+        timer.Start();
+        std::vector<double> slice(m_data.begin() + begin, m_data.begin() + end);
+        DCRTPoly encoded_poly = encodeVector(cc, slice, m_slotPacking);
+        MKCiphertext ciphertext = Encrypt(m_encryptionContext, encoded_poly, m_uploadTowers);
+        timings.t_encrypt_ms += timer.Stop();
+
+        // 3. Mask it from the chunk's offset in every pairwise keystream.
+        timer.Start();
+        ApplyChunkMask(m_id, secrets, chunk, ciphertext.c1);
+        timings.t_mask_gen_ms += timer.Stop();
+
+        ClientShare share;
+        packShare(ciphertext, share);
+        share.chunkIndex = chunk;
+        sink(share);
+    }
+
+    timings.t_client_total_ms = timings.t_encrypt_ms + timings.t_mask_gen_ms;
+    return timings;
+}
+
+// Derives and caches the shared secret with every peer for use in later rounds.
+void Client::establishPairwiseSecrets(const PeerKeyDirectory& peerKeys, const MaskingGraph& graph) {
+    Timer timer;
+    timer.Start();
+    m_pairwiseSecrets = ComputePairwiseSecrets(m_id, m_ecdhKeys, peerKeys, graph.neighbours(m_id));
+    m_keyGenTimings.t_pairwise_ms = timer.Stop();
+    m_secretsEstablished = true;
+}
+
+// Same protocol as prepareShareForServer, but masks are derived from the cached
+// pairwise secrets and the round number instead of fresh ECDH derivations.
+ClientResult Client::prepareShareForRound(CryptoContext<DCRTPoly>& cc, uint32_t round) {
+    if (!m_secretsEstablished) {
+        throw std::runtime_error("establishPairwiseSecrets() must be called before prepareShareForRound()");
+    }
+
+    ClientResult result;
+    Timer timer;
+    result.timings.key_gen = m_keyGenTimings;
+
+    // 1. Measure Encoding and Encryption.
+    timer.Start();
+    DCRTPoly encoded_poly = encodeVector(cc, m_data, m_slotPacking);
+    // Only the towers the aggregate needs are computed; the mask below is then
+    // only expanded for those.
+    MKCiphertext ciphertext = Encrypt(m_encryptionContext, encoded_poly, m_uploadTowers);
+    result.timings.t_encrypt_ms = timer.Stop();
+
+    // 2. Measure Mask Generation Time (KDF + PRG only).
+    timer.Start();
+    ApplyRoundMask(m_id, m_pairwiseSecrets, round, ciphertext.c1);
+    result.timings.t_mask_gen_ms = timer.Stop();
+
+    // 3. The masked share is now d + r_i.
+    packShare(ciphertext, result.share);
+
+    result.timings.t_client_total_ms = result.timings.t_encrypt_ms + result.timings.t_mask_gen_ms;
+    return result;
+}
+
+// Everything except the data-dependent additions, for a window of future rounds.
+double Client::precomputeRounds(uint32_t firstRound, uint32_t numRounds) {
+    if (!m_secretsEstablished) {
+        throw std::runtime_error("establishPairwiseSecrets() must be called before precomputeRounds()");
+    }
+    double total_ms = 0.0;
+    Timer timer;
+    for (uint32_t round = firstRound; round < firstRound + numRounds; ++round) {
+        timer.Start();
+        BufferedRound buffered;
+        // Computed at the upload towers only, so the mask is only expanded for those.
+        buffered.pad = PrecomputeEncryptionPad(m_encryptionContext, m_uploadTowers);
+        ApplyRoundMask(m_id, m_pairwiseSecrets, round, buffered.pad.c1Pad);
+        buffered.t_offline_ms = timer.Stop();
+        total_ms += buffered.t_offline_ms;
+        m_roundPads[round] = std::move(buffered);
+    }
+    return total_ms;
+}
+
+// The online step: one encode and at most two polynomial additions.
+ClientResult Client::prepareShareOnline(CryptoContext<DCRTPoly>& cc, uint32_t round) {
+    auto it = m_roundPads.find(round);
+    if (it == m_roundPads.end()) {
+        throw std::runtime_error("No precomputed pad for round " + std::to_string(round));
+    }
+
+    ClientResult result;
+    Timer timer;
+    result.timings.key_gen = m_keyGenTimings;
+    result.timings.t_offline_ms = it->second.t_offline_ms;
+
+    timer.Start();
+    DCRTPoly encoded_poly = encodeVector(cc, m_data, m_slotPacking);
+    MKCiphertext ciphertext = EncryptWithPad(std::move(it->second.pad), encoded_poly);
+    m_roundPads.erase(it); // A pad must never encrypt a second plaintext.
+    packShare(ciphertext, result.share);
+    result.timings.t_encrypt_ms = timer.Stop();
+
+    // The mask was added offline.
+    result.timings.t_client_total_ms = result.timings.t_encrypt_ms;
+    return result;
+}
+
+size_t Client::getNumBufferedRounds() const {
+    return m_roundPads.size();
+}
 
 uint32_t Client::getId() const {
     return m_id;
@@ -95,3 +257,7 @@ const std::vector<double>& Client::getData() const {
 ECDHPublicKey Client::getECDHPublicKey() const {
     return SerializePublicKey(m_ecdhKeys);
 }
+
+ECDHPublicKey Client::getRawECDHPublicKey() const {
+    return SerializeRawPublicKey(m_ecdhKeys);
+}
@@ -4,6 +4,11 @@
 #define CLIENT_H
 
 #include "common.h"
+#include "mk_ckks.h"
+#include <functional>
+
+class PeerKeyDirectory; // Defined in masking.h.
+class MaskingGraph;     // Defined in masking.h.
 
 class Client {
 public:
@@ -14,17 +19,71 @@ public:
     void generateKeys(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a);
 
     void generateData(uint32_t dataSize, double minVal = -10.0, double maxVal = 10.0);
-    ClientResult prepareShareForServer(CryptoContext<DCRTPoly>& cc, const std::map<uint32_t, ECDHPublicKey>& allPublicKeys);
+    // Selects the upload format of subsequent shares (SPLIT by default).
+    void setShareFormat(ShareFormat format);
+    // Selects how the data vector is laid out in the CKKS slots (REAL by default).
+    void setSlotPacking(SlotPacking packing);
+    // Uploads only the first numTowers RNS towers (see MinimalTowerCount). 0 = all towers.
+    void setUploadTowers(uint32_t numTowers);
+
+    // Masks only with this client's neighbours in `graph` (every peer for the complete graph).
+    ClientResult prepareShareForServer(CryptoContext<DCRTPoly>& cc, const PeerKeyDirectory& peerKeys,
+                                       const MaskingGraph& graph);
+
+    // --- Tensor API ---
+    // For updates longer than one ciphertext: the data vector is split into
+    // chunks of ChunkCapacity(cc) values, and each chunk's masked share is handed
+    // to `sink` as soon as it is ready, so only one chunk is in flight. The ECDH
+    // secrets are derived once; chunks are masked through keystream offsets.
+    // Chunks are produced starting at (id mod numChunks) so that concurrent
+    // clients feed different server accumulators. Returns the summed timings.
+    ClientTimings prepareTensorShares(CryptoContext<DCRTPoly>& cc, const PeerKeyDirectory& peerKeys,
+                                      const MaskingGraph& graph,
+                                      const std::function<void(ClientShare&)>& sink);
+
+    // --- Multi-Round API ---
+    // Set up once with establishPairwiseSecrets(), then call prepareShareForRound()
+    // for every round. The keys and pairwise ECDH secrets are reused; only
+    // encryption, the per-round seed KDF and the PRG expansion are paid per round.
+    void establishPairwiseSecrets(const PeerKeyDirectory& peerKeys, const MaskingGraph& graph);
+    ClientResult prepareShareForRound(CryptoContext<DCRTPoly>& cc, uint32_t round);
+
+    // --- Offline/Online API (multi-round mode) ---
+    // Offline: for each round in [firstRound, firstRound + numRounds), precompute
+    // the encryption pad at the upload towers only and add that round's mask,
+    // then buffer it. Requires establishPairwiseSecrets(). Returns the time spent.
+    double precomputeRounds(uint32_t firstRound, uint32_t numRounds);
+    // Online: encode the data and add it into the buffered pad for `round`, which
+    // is consumed. Throws if no pad was precomputed for that round.
+    ClientResult prepareShareOnline(CryptoContext<DCRTPoly>& cc, uint32_t round);
+    size_t getNumBufferedRounds() const;
 
     uint32_t getId() const;
     const std::vector<double>& getData() const;
-    ECDHPublicKey getECDHPublicKey() const;
+    ECDHPublicKey getECDHPublicKey() const;    // DER-encoded.
+    ECDHPublicKey getRawECDHPublicKey() const; // Raw 32 bytes, for RawKeyDirectory.
 
 private:
     uint32_t m_id;
     MKeyGenKeyPair m_keys;
+    EncryptionContext m_encryptionContext; // m_keys in prepared form (see PrepareEncryptionContext).
     SafePKey m_ecdhKeys;
     std::vector<double> m_data;
+    std::vector<PairwiseSecret> m_pairwiseSecrets; // Cached for multi-round mode.
+    bool m_secretsEstablished{false};
+    ShareFormat m_shareFormat{ShareFormat::SPLIT};
+    SlotPacking m_slotPacking{SlotPacking::REAL};
+    uint32_t m_uploadTowers{0};
+
+    // Precomputed, already masked pads of future rounds, each used exactly once.
+    struct BufferedRound {
+        EncryptionPad pad;
+        double t_offline_ms{0.0};
+    };
+    std::map<uint32_t, BufferedRound> m_roundPads;
+
+    // Moves the masked ciphertext into a share of the selected format.
+    void packShare(MKCiphertext& ciphertext, ClientShare& share) const;
 
     // NEW: Add a member variable to permanently store this client's key generation timings.
     KeyGenTimings m_keyGenTimings;
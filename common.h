@@ -50,10 +50,33 @@ public:
     DCRTPoly c1; // This now represents the partial decryption share 'd'
 };
 
+// Everything in an encryption that does not depend on the plaintext, computed
+// offline: c0Pad = v*b + e0 and c1Pad = (v*a + e1)*s + e* (plus, once masked,
+// the client's round mask). Encrypting is then c0 = c0Pad + m, c1 = c1Pad.
+// A pad must be used for exactly one plaintext.
+struct EncryptionPad {
+    DCRTPoly c0Pad;
+    DCRTPoly c1Pad;
+};
+
+// Selects what a client uploads. The server only ever needs c0 + d_masked.
+enum class ShareFormat {
+    SPLIT,   // Upload c0 and d_masked as two polynomials.
+    COMPACT  // Upload the single polynomial c0 + d_masked (half the uplink).
+};
+
+// Selects how a real vector is laid out in the CKKS slots.
+enum class SlotPacking {
+    REAL,    // x_j in the real part of slot j; imaginary parts stay empty.
+    COMPLEX  // Slot j carries x_j + i * x_{j+h} with h = ceil(d/2): half the slots.
+};
+
 // Represents the data a client sends to the server for aggregation.
 struct ClientShare {
-    DCRTPoly c0;
-    DCRTPoly d_masked; // This now holds the masked value: d + r_i
+    DCRTPoly c0;       // In COMPACT format this already holds c0 + d_masked.
+    DCRTPoly d_masked; // This now holds the masked value: d + r_i (empty in COMPACT format)
+    ShareFormat format{ShareFormat::SPLIT};
+    uint32_t chunkIndex{0}; // Position within a multi-ciphertext tensor (0 for a single ciphertext).
 };
 
 // --- Custom Data Structures for the Masking Protocol (Restored) ---
@@ -64,6 +87,12 @@ struct EVP_PKEY_Deleter {
 using SafePKey = std::unique_ptr<EVP_PKEY, EVP_PKEY_Deleter>;
 using ECDHPublicKey = std::vector<unsigned char>;
 
+// A cached ECDH shared secret with one peer, reused across training rounds.
+struct PairwiseSecret {
+    uint32_t peerId;
+    std::vector<unsigned char> secret;
+};
+
 
 // --- Data Structures for Performance Measurement ---
 
@@ -71,6 +100,7 @@ struct KeyGenTimings {
     double t_mkckks_ms{0.0};
     double t_ecdh_ms{0.0};
     double t_total_ms{0.0};
+    double t_pairwise_ms{0.0}; // One-time derivation of all pairwise secrets (multi-round mode).
 };
 
 // MODIFIED: Cleaned up to reflect the new combined cryptographic step.
@@ -80,6 +110,7 @@ struct ClientTimings {
     // t_partial_dec_ms has been removed.
     double t_mask_gen_ms{0.0};
     double t_client_total_ms{0.0};
+    double t_offline_ms{0.0}; // Precomputation consumed by this share (off the critical path).
 };
 
 struct ClientResult {
@@ -98,4 +129,39 @@ struct ServerResult {
     ServerTimings timings;
 };
 
+// --- Shared Helpers ---
+
+/**
+ * @brief Calculates the smallest power of two that is greater than or equal to n.
+ * This is crucial for determining the required batch size for the CKKS scheme,
+ * which must be a power of two to support the underlying NTT/FFT operations.
+ *
+ * @param n The input data size.
+ * @return uint32_t The next power of two.
+ */
+inline uint32_t next_power_of_2(uint32_t n) {
+    // If n is already a power of two, we don't need to do anything.
+    // The check (n & (n - 1)) == 0 is a standard bitwise trick to identify powers of two.
+    if (n > 0 && (n & (n - 1)) == 0) {
+        return n;
+    }
+
+    // This sequence of bitwise OR operations ensures that all bits to the right
+    // of the most significant bit are set to 1.
+    // For example, if n = 60000 (binary: 1110101001100000), this process
+    // will transform it into 1111111111111111.
+    n--; // Decrement n to handle the case where n is already a power of two.
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+
+    // Incrementing the result gives us the next highest power of two.
+    // For our example, this turns 1111111111111111 into 10000000000000000 (65536).
+    n++;
+
+    return n;
+}
+
 #endif // COMMON_H
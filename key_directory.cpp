@@ -0,0 +1,129 @@
+// key_directory.cpp
+//
+// Implementation of the fixed-stride raw public key directory and its
+// file/mmap broadcast format.
+
+#include "key_directory.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned char MAGIC[4] = {'S', 'F', 'K', 'D'};
+const uint32_t VERSION = 1;
+
+void WriteU32(unsigned char* dst, uint32_t v) {
+    for (int b = 0; b < 4; ++b) dst[b] = static_cast<unsigned char>(v >> (8 * b));
+}
+
+uint32_t ReadU32(const unsigned char* src) {
+    uint32_t v = 0;
+    for (int b = 0; b < 4; ++b) v |= static_cast<uint32_t>(src[b]) << (8 * b);
+    return v;
+}
+
+} // namespace
+
+RawKeyDirectory::RawKeyDirectory(uint32_t count)
+    : m_owned(HEADER_BYTES + KEY_BYTES * static_cast<size_t>(count), 0), m_count(count) {
+    std::memcpy(m_owned.data(), MAGIC, sizeof(MAGIC));
+    WriteU32(m_owned.data() + 4, VERSION);
+    WriteU32(m_owned.data() + 8, count);
+    WriteU32(m_owned.data() + 12, static_cast<uint32_t>(KEY_BYTES));
+    m_data = m_owned.data();
+    m_bytes = m_owned.size();
+}
+
+RawKeyDirectory RawKeyDirectory::MapFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open key directory: " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_BYTES) {
+        ::close(fd);
+        throw std::runtime_error("Key directory is truncated: " + path);
+    }
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file contents reachable.
+    if (mapping == MAP_FAILED) throw std::runtime_error("Failed to mmap key directory: " + path);
+
+    const unsigned char* data = static_cast<const unsigned char*>(mapping);
+    uint32_t count = ReadU32(data + 8);
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || ReadU32(data + 4) != VERSION ||
+        ReadU32(data + 12) != KEY_BYTES || bytes != HEADER_BYTES + KEY_BYTES * static_cast<size_t>(count)) {
+        ::munmap(mapping, bytes);
+        throw std::runtime_error("Malformed key directory: " + path);
+    }
+
+    RawKeyDirectory dir;
+    dir.m_mapping = mapping;
+    dir.m_data = data;
+    dir.m_bytes = bytes;
+    dir.m_count = count;
+    return dir;
+}
+
+RawKeyDirectory::~RawKeyDirectory() {
+    release();
+}
+
+void RawKeyDirectory::release() {
+    if (m_mapping) ::munmap(m_mapping, m_bytes);
+    m_mapping = nullptr;
+}
+
+RawKeyDirectory::RawKeyDirectory(RawKeyDirectory&& other) noexcept {
+    *this = std::move(other);
+}
+
+RawKeyDirectory& RawKeyDirectory::operator=(RawKeyDirectory&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_owned = std::move(other.m_owned);
+        m_mapping = other.m_mapping;
+        m_data = m_mapping ? other.m_data : m_owned.data();
+        m_bytes = other.m_bytes;
+        m_count = other.m_count;
+        other.m_mapping = nullptr;
+        other.m_data = nullptr;
+        other.m_bytes = 0;
+        other.m_count = 0;
+    }
+    return *this;
+}
+
+void RawKeyDirectory::setKey(uint32_t id, const std::vector<unsigned char>& rawKey) {
+    if (m_mapping) throw std::runtime_error("Cannot modify a memory-mapped key directory");
+    if (id >= m_count) throw std::out_of_range("Client ID outside the key directory");
+    if (rawKey.size() != KEY_BYTES) throw std::invalid_argument("Raw public key must be 32 bytes");
+    std::memcpy(m_owned.data() + HEADER_BYTES + KEY_BYTES * id, rawKey.data(), KEY_BYTES);
+}
+
+std::string RawKeyDirectory::writeToTempFile(const std::string& directory) const {
+    std::string path = directory + "/secure_fl_keys_XXXXXX";
+    int fd = ::mkstemp(&path[0]); // Unpredictable name, created 0600 with O_EXCL.
+    if (fd < 0) throw std::runtime_error("Failed to create a key directory file in " + directory);
+    writeToFd(fd, path);
+    return path;
+}
+
+void RawKeyDirectory::writeToFd(int fd, const std::string& path) const {
+    size_t written = 0;
+    while (written < m_bytes) {
+        ssize_t n = ::write(fd, m_data + written, m_bytes - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ::close(fd);
+            ::unlink(path.c_str());
+            throw std::runtime_error("Failed to write key directory: " + path);
+        }
+        written += static_cast<size_t>(n);
+    }
+    ::close(fd);
+}
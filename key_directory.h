@@ -0,0 +1,60 @@
+// key_directory.h
+//
+// Header file for the compact public key directory. Instead of a map of
+// separately allocated DER blobs (44 bytes per X25519 key), all raw 32-byte
+// keys live in one contiguous, fixed-stride buffer indexed by client ID. The
+// buffer is the broadcast format: it can be written to a file once and
+// memory-mapped read-only by every simulated client.
+
+#ifndef KEY_DIRECTORY_H
+#define KEY_DIRECTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Layout: a 16-byte header ("SFKD", version, key count, stride; little-endian
+// uint32 fields) followed by `count` keys, client i's key at 16 + 32 * i.
+class RawKeyDirectory {
+public:
+    static constexpr size_t KEY_BYTES = 32;
+    static constexpr size_t HEADER_BYTES = 16;
+
+    // Creates an owning, zero-filled directory for client IDs [0, count).
+    explicit RawKeyDirectory(uint32_t count);
+
+    // Maps a directory file read-only; the mapping lives as long as the object.
+    static RawKeyDirectory MapFile(const std::string& path);
+
+    ~RawKeyDirectory();
+    RawKeyDirectory(RawKeyDirectory&& other) noexcept;
+    RawKeyDirectory& operator=(RawKeyDirectory&& other) noexcept;
+    RawKeyDirectory(const RawKeyDirectory&) = delete;
+    RawKeyDirectory& operator=(const RawKeyDirectory&) = delete;
+
+    // Stores client `id`'s raw public key (must be exactly KEY_BYTES long).
+    void setKey(uint32_t id, const std::vector<unsigned char>& rawKey);
+    const unsigned char* keyAt(uint32_t id) const { return m_data + HEADER_BYTES + KEY_BYTES * id; }
+
+    uint32_t size() const { return m_count; }
+    size_t byteSize() const { return m_bytes; }
+
+    // Writes the directory to a new file with a unique, unpredictable name in
+    // `directory` (mkstemp, mode 0600) and returns its path.
+    std::string writeToTempFile(const std::string& directory) const;
+
+private:
+    RawKeyDirectory() = default;
+    void release();
+    // Writes all bytes to `fd` and closes it; removes `path` on failure.
+    void writeToFd(int fd, const std::string& path) const;
+
+    std::vector<unsigned char> m_owned; // Backing storage when not mapped.
+    const unsigned char* m_data{nullptr};
+    size_t m_bytes{0};
+    uint32_t m_count{0};
+    void* m_mapping{nullptr};           // Non-null when backed by mmap.
+};
+
+#endif // KEY_DIRECTORY_H
@@ -10,46 +10,22 @@
 #include "mk_ckks.h"
 #include "client.h"
 #include "server.h"
+#include "masking.h"
+#include "benchmarks.h"
+#include "parallel.h"
+#include "param_tuner.h"
+#include "noise_sampler.h"
+#include "aggregation_tree.h"
+#include "sharded_server.h"
+#include "share_wire.h"
 #include <vector>
 #include <memory>
 #include <filesystem>
 #include <sstream> // Required for serialization to in-memory streams
+#include <cstring>
 
 
 
-/**
- * @brief Calculates the smallest power of two that is greater than or equal to n.
- * This is crucial for determining the required batch size for the CKKS scheme,
- * which must be a power of two to support the underlying NTT/FFT operations.
- *
- * @param n The input data size.
- * @return uint32_t The next power of two.
- */
-uint32_t next_power_of_2(uint32_t n) {
-    // If n is already a power of two, we don't need to do anything.
-    // The check (n & (n - 1)) == 0 is a standard bitwise trick to identify powers of two.
-    if (n > 0 && (n & (n - 1)) == 0) {
-        return n;
-    }
-
-    // This sequence of bitwise OR operations ensures that all bits to the right
-    // of the most significant bit are set to 1.
-    // For example, if n = 60000 (binary: 1110101001100000), this process
-    // will transform it into 1111111111111111.
-    n--; // Decrement n to handle the case where n is already a power of two.
-    n |= n >> 1;
-    n |= n >> 2;
-    n |= n >> 4;
-    n |= n >> 8;
-    n |= n >> 16;
-
-    // Incrementing the result gives us the next highest power of two.
-    // For our example, this turns 1111111111111111 into 10000000000000000 (65536).
-    n++;
-
-    return n;
-}
-
 // =================================================================================
 // EXPERIMENT CONFIGURATION
 // =================================================================================
@@ -62,25 +38,182 @@ const uint32_t FIXED_DATA_SIZE_FOR_EXP1 = 65536;
 const int FIXED_CLIENT_COUNT_FOR_EXP2 = 500;
 const std::vector<uint32_t> DATA_SIZES = {4095, 8192, 16384, 32768, 50000, 65536};
 
+// --- Experiment 4: Large Models (multi-ciphertext updates, --model-size D) ---
+const std::vector<int> LARGE_MODEL_CLIENT_COUNTS = {10, 50};
+
+// --- Experiment 5: Aggregation Tree (--agg-tree N) ---
+// Fan-outs swept for one cohort; the last entry 0 stands for a single flat
+// aggregator (fan-out = cohort size, depth 1).
+const std::vector<uint32_t> TREE_FAN_OUTS = {8, 32, 128, 0};
+const uint32_t TREE_DATA_SIZE = 4096;
+// Masking degree used when --mask-degree is not given: a complete graph over a
+// cohort of 10k+ clients would cost every client 10k+ ECDH derivations.
+const int TREE_DEFAULT_MASK_DEGREE = 16;
+
+// --- Sharded aggregation (--shards S) ---
+// Upper bound on S: every shard is a forked process with its own accumulators.
+const int MAX_SHARDS = 64;
+
+// Client vectors are drawn uniformly from [-CLIENT_DATA_MAX_ABS, CLIENT_DATA_MAX_ABS].
+const double CLIENT_DATA_MAX_ABS = 999.0;
+
+// --- Runtime Options (set from the command line) ---
+struct HarnessOptions {
+    // Worker threads used to simulate independent clients. 0 = all available cores.
+    int numThreads{0};
+    // Masking graph degree k (SecAgg+ style). 0 = complete graph (mask with every peer).
+    int maskDegree{0};
+    // Parameters per model update for Experiment 4. 0 = skip; > 0 runs it
+    // instead of Experiments 1 and 2.
+    uint32_t modelSize{0};
+    // Training rounds per cohort. > 1 runs the multi-round experiment (Experiment 3)
+    // instead of Experiments 1 and 2.
+    int numRounds{1};
+    // Multi-round mode: rounds of encryption randomness and masks each client
+    // precomputes ahead (offline/online split). 0 = encrypt and mask online.
+    int offlinePool{0};
+    // Upload c0 + d_masked as a single polynomial instead of two.
+    ShareFormat shareFormat{ShareFormat::SPLIT};
+    // Drop the RNS towers the aggregate does not need before upload.
+    bool reduceTowers{true};
+    // Pick CKKS parameters with the tuner (param_tuner.h) rather than the fixed set.
+    bool tuneParameters{true};
+    // Target precision for the tuner: max error of the decoded sum <= 2^-precisionBits.
+    uint32_t precisionBits{20};
+    // Pack two real values per slot (real and imaginary part).
+    SlotPacking slotPacking{SlotPacking::REAL};
+    // STREAMING folds shares in on arrival; BUFFERED keeps them and sums all at
+    // once with the lazy-reduction kernel (aggregate_kernels.h).
+    AggregationMode aggregationMode{AggregationMode::STREAMING};
+    // Cohort size for Experiment 5. 0 = skip; > 0 runs it instead of Experiments 1 and 2.
+    uint32_t treeCohort{0};
+    // Experiment 5: a single fan-out or depth instead of the TREE_FAN_OUTS sweep (0 = sweep).
+    uint32_t treeFanOut{0};
+    uint32_t treeDepth{0};
+    // Experiment 5: run each subtree below the root as a forked process instead of in threads.
+    bool treeProcesses{false};
+    // Split every share's words across this many aggregator processes
+    // (sharded_server.h). 0 = a single in-process Server.
+    uint32_t numShards{0};
+    // Serialize every share into the flat wire format (share_wire.h) and have
+    // the server sum it straight from the buffer, as it would off the network.
+    bool wireShares{false};
+    // Coefficient encoding of those wire shares (PACKED with --packed-shares).
+    ShareEncoding shareEncoding{ShareEncoding::RAW64};
+};
+
+// =================================================================================
+// HELPER FUNCTION FOR CRYPTO CONTEXT GENERATION
+// =================================================================================
+
+/**
+ * @brief Builds the CKKS CryptoContext used for one experiment configuration.
+ * The ring dimension is twice the (power-of-two) batch size, with a floor of 16384.
+ * The batch size is capped at MAX_BATCH_SIZE; longer vectors span several ciphertexts.
+ * @param dataSize The length of each client's vector.
+ * @param ringDimension Output: the ring dimension that was selected.
+ * @return The generated CryptoContext with PKE enabled.
+ */
+CryptoContext<DCRTPoly> make_crypto_context(uint32_t dataSize, uint32_t& ringDimension) {
+    uint32_t batchSize = std::min(next_power_of_2(dataSize), MAX_BATCH_SIZE);
+    if (batchSize < 16384){
+        ringDimension = 16384;
+    }
+    else{
+        ringDimension = 2 * batchSize;
+    }
+
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(ringDimension);
+    parameters.SetMultiplicativeDepth(1);
+    parameters.SetScalingModSize(50);
+    parameters.SetBatchSize(batchSize);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    return cc;
+}
+
+// =================================================================================
+// HELPER FUNCTION FOR PUBLIC KEY DISTRIBUTION
+// =================================================================================
+
+/**
+ * @brief Simulates the broadcast of all clients' ECDH public keys.
+ * The keys are packed into a fixed-stride RawKeyDirectory (32 bytes per key),
+ * written to a broadcast file, and memory-mapped back, exactly as a receiving
+ * client would load it. The mapped keys are parsed once into the shared
+ * PeerKeyDirectory, without any DER decoding.
+ * @param clients All clients, whose IDs must be 0..n-1.
+ * @param setup_bytes Output: the size of the broadcast blob in bytes.
+ * @return The directory shared read-only by every client thread.
+ */
+PeerKeyDirectory broadcast_public_keys(const std::vector<Client>& clients, size_t& setup_bytes) {
+    RawKeyDirectory directory(static_cast<uint32_t>(clients.size()));
+    for (const auto& client : clients) {
+        directory.setKey(client.getId(), client.getRawECDHPublicKey());
+    }
+
+    const std::string blob_path = directory.writeToTempFile(std::filesystem::temp_directory_path().string());
+    RawKeyDirectory mapped = RawKeyDirectory::MapFile(blob_path);
+    setup_bytes = mapped.byteSize();
+
+    PeerKeyDirectory peerKeys(mapped);
+    std::filesystem::remove(blob_path);
+    return peerKeys;
+}
+
+/**
+ * @brief Builds the masking graph for a cohort from the harness options.
+ * The k-regular graph's permutation comes from a fresh public seed, which in a
+ * deployment the server would broadcast alongside the key directory.
+ */
+MaskingGraph make_masking_graph(int numClients, const HarnessOptions& options) {
+    if (options.maskDegree <= 0) {
+        return MaskingGraph::Complete(numClients);
+    }
+    std::random_device rd;
+    uint64_t public_seed = (static_cast<uint64_t>(rd()) << 32) | rd();
+    return MaskingGraph::KRegular(numClients, options.maskDegree, public_seed);
+}
+
 // =================================================================================
 // HELPER FUNCTIONS FOR COMMUNICATION COST MEASUREMENT
 // =================================================================================
 
 /**
- * @brief Measures the serialized size of a standard MKCiphertext (c0, c1).
- * This is used to calculate the ciphertext expansion factor.
+ * @brief Encrypts a zero plaintext under a fresh key pair, as a representative MKCiphertext (c0, c1).
  * @param cc The crypto context.
- * @param pk A client's public key, needed for the encryption operation.
- * @return The size of the serialized ciphertext in bytes.
+ * @param crs_a The common reference string for key generation.
  */
-size_t get_mkciphertext_size(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a) {
+MKCiphertext make_representative_ciphertext(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a) {
     // Create a dummy zero plaintext for encryption
     auto params = cc->GetCryptoParameters()->GetElementParams();
     DCRTPoly dummy_plaintext(params, Format::EVALUATION, true);
     MKeyGenKeyPair dummy_keys = KeyGenSingle(cc, crs_a);
-    
-    // Perform a standard encryption to get a representative ciphertext object.
-    MKCiphertext ct = Encrypt(cc, dummy_keys.pk, dummy_keys.sk, dummy_plaintext);
+    return Encrypt(cc, dummy_keys.pk, dummy_keys.sk, dummy_plaintext);
+}
+
+/**
+ * @brief Measures the size of a standard MKCiphertext (c0, c1) in the flat wire format.
+ * This is used to calculate the ciphertext expansion factor.
+ * @param encoding 64-bit or bit-packed coefficients.
+ * @return The size of the serialized ciphertext in bytes.
+ */
+size_t get_mkciphertext_size(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a,
+                             ShareEncoding encoding = ShareEncoding::RAW64) {
+    MKCiphertext ct = make_representative_ciphertext(cc, crs_a);
+    // Same shape as a SPLIT share: two full-tower polynomials.
+    ClientShare as_share;
+    as_share.c0 = std::move(ct.c0);
+    as_share.d_masked = std::move(ct.c1);
+    return ShareWireSize(as_share, encoding);
+}
+
+/**
+ * @brief Measures the size of the same ciphertext serialized with lbcrypto::Serial (cereal), for comparison.
+ */
+size_t get_mkciphertext_cereal_size(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a) {
+    MKCiphertext ct = make_representative_ciphertext(cc, crs_a);
 
     // Serialize the object into an in-memory stream and return its size.
     std::stringstream ss;
@@ -92,26 +225,139 @@ size_t get_mkciphertext_size(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a)
 
 
 /**
- * @brief Measures the serialized size of the ClientShare object (c0, d_masked).
+ * @brief Measures the size of the ClientShare object (c0, d_masked), or of
+ * c0 alone for a COMPACT share, in the flat wire format (share_wire.h).
  * This represents the true client uplink communication cost.
  * @param share The ClientShare object to measure.
+ * @param encoding 64-bit or bit-packed coefficients.
  * @return The size of the serialized share in bytes.
  */
-size_t get_client_share_size(const ClientShare& share) {
+size_t get_client_share_size(const ClientShare& share, ShareEncoding encoding = ShareEncoding::RAW64) {
+    return ShareWireSize(share, encoding);
+}
+
+/**
+ * @brief Measures the size of the same share serialized with lbcrypto::Serial (cereal), for comparison.
+ */
+size_t get_client_share_cereal_size(const ClientShare& share) {
     std::stringstream ss;
     lbcrypto::Serial::Serialize(share.c0, ss, lbcrypto::SerType::BINARY);
-    lbcrypto::Serial::Serialize(share.d_masked, ss, lbcrypto::SerType::BINARY);
+    if (share.format == ShareFormat::SPLIT) {
+        lbcrypto::Serial::Serialize(share.d_masked, ss, lbcrypto::SerType::BINARY);
+    }
     return ss.str().size();
 }
 
+/**
+ * @brief Formats an error magnitude in scientific notation without touching std::cout's state.
+ */
+std::string format_error(double error) {
+    std::ostringstream oss;
+    oss << std::scientific << std::setprecision(3) << error;
+    return oss.str();
+}
+
+/**
+ * @brief Computes the largest deviation of the decoded aggregate from the exact sum.
+ * @param clients All clients of the round, holding their plaintext vectors.
+ * @param decoded The server's decoded result.
+ * @return max_j |decoded[j] - sum_i x_i[j]|.
+ */
+double max_aggregate_error(const std::vector<Client>& clients, const std::vector<double>& decoded) {
+    std::vector<double> exact(decoded.size(), 0.0);
+    for (const auto& client : clients) {
+        const std::vector<double>& data = client.getData();
+        for (size_t j = 0; j < exact.size(); ++j) {
+            exact[j] += data[j];
+        }
+    }
+    double max_error = 0.0;
+    for (size_t j = 0; j < exact.size(); ++j) {
+        max_error = std::max(max_error, std::abs(decoded[j] - exact[j]));
+    }
+    return max_error;
+}
+
+/**
+ * @brief Builds the CryptoContext for one experiment and records its parameters.
+ * By default the parameter tuner picks the ring dimension and moduli from the
+ * cohort size, vector length, value range and --precision. With --fixed-params
+ * the original fixed set (make_crypto_context) is used instead, and only the
+ * predictions are filled in.
+ * @return The parameters, including the context and the upload tower count.
+ */
+TunedParameters make_experiment_context(int numClients, uint32_t dataSize, const HarnessOptions& options) {
+    TuningRequest request;
+    request.numClients = numClients;
+    request.dataSize = dataSize;
+    request.maxAbs = CLIENT_DATA_MAX_ABS;
+    request.precisionBits = options.precisionBits;
+    request.shareFormat = options.shareFormat;
+    request.reduceTowers = options.reduceTowers;
+    request.slotPacking = options.slotPacking;
+
+    TunedParameters tuned;
+    if (options.tuneParameters) {
+        tuned = TuneParameters(request);
+    } else {
+        uint32_t slots = SlotsForData(dataSize, options.slotPacking);
+        tuned.cc = make_crypto_context(slots, tuned.ringDim);
+        auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(tuned.cc->GetCryptoParameters());
+        tuned.batchSize = std::min(next_power_of_2(slots), MAX_BATCH_SIZE);
+        tuned.scalingModSize = 50;
+        tuned.numTowers = cryptoParams->GetElementParams()->GetParams().size();
+        tuned.uploadTowers = options.reduceTowers
+            ? MinimalTowerCount(tuned.cc, numClients, SlotMagnitude(CLIENT_DATA_MAX_ABS, options.slotPacking))
+            : tuned.numTowers;
+        Plaintext probe = tuned.cc->MakeCKKSPackedPlaintext(std::vector<double>{0.0});
+        tuned.predictedMaxError = PredictAggregateError(numClients, tuned.ringDim, probe->GetScalingFactor(),
+                                                        cryptoParams->GetDistributionParameter());
+        tuned.numChunks = NumChunks(dataSize, ChunkCapacity(tuned.cc, options.slotPacking));
+        size_t poly_bytes = static_cast<size_t>(tuned.uploadTowers) * tuned.ringDim * sizeof(uint64_t);
+        size_t chunk_bytes = (options.shareFormat == ShareFormat::COMPACT) ? poly_bytes : 2 * poly_bytes;
+        tuned.predictedShareBytes = tuned.numChunks * chunk_bytes;
+    }
+
+    std::cout << (options.tuneParameters ? "Tuned" : "Fixed") << " parameters: N_poly=" << tuned.ringDim
+              << ", scaling mod " << tuned.scalingModSize << " bits, uploading " << tuned.uploadTowers
+              << " of " << tuned.numTowers << " towers x " << tuned.numChunks
+              << " chunk(s), predicted max error " << format_error(tuned.predictedMaxError)
+              << ", predicted share " << (tuned.predictedShareBytes / 1024.0) << " KB" << std::endl;
+    return tuned;
+}
+
+/**
+ * @brief Returns the label used for a slot packing mode in logs.
+ */
+const char* slot_packing_name(SlotPacking packing) {
+    return packing == SlotPacking::COMPLEX ? "Complex" : "Real";
+}
+
+/**
+ * @brief Returns the label used for a share format in logs and console output.
+ */
+const char* share_format_name(ShareFormat format) {
+    return format == ShareFormat::COMPACT ? "Compact" : "Split";
+}
+
 // =================================================================================
 // FORWARD DECLARATION of the main experiment runner function
 // =================================================================================
 void run_experiment(const std::string& experiment_name,
                       int numClients, uint32_t dataSize,
+                      const HarnessOptions& options,
                       std::ofstream& compute_client_log, std::ofstream& compute_server_log,
                       std::ofstream& comm_log);
 
+void run_multiround_experiment(const std::string& experiment_name,
+                               int numClients, uint32_t dataSize,
+                               const HarnessOptions& options,
+                               std::ofstream& rounds_log, std::ofstream& rounds_summary_log);
+
+void run_tree_experiment(const std::string& experiment_name,
+                         int numClients, uint32_t dataSize,
+                         const HarnessOptions& options, std::ofstream& tree_log);
+
 
 
 
@@ -189,7 +435,145 @@ void run_experiment(const std::string& experiment_name,
 // MAIN ORCHESTRATOR
 // =================================================================================
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --- Parse Command-Line Options ---
+    HarnessOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        // Kernel self-checks and microbenchmarks run instead of the experiments.
+        if (arg == "--bench-reduce") return RunReduceBenchmark();
+        if (arg == "--bench-ecdh") return RunECDHBenchmark();
+        if (arg == "--verify-mask-graph") return RunMaskGraphVerifier();
+        if (arg == "--bench-noise") return RunNoiseSamplerBenchmark();
+        if (arg == "--bench-encrypt") return RunEncryptBenchmark();
+        if (arg == "--bench-aggregate") return RunAggregateBenchmark();
+        if (arg == "--bench-ingest") return RunIngestBenchmark();
+        if (arg == "--bench-wire") return RunWireFormatBenchmark();
+        if (arg == "--bench-pack") return RunPackBenchmark();
+        if (arg == "--threads" && i + 1 < argc) {
+            options.numThreads = std::stoi(argv[++i]);
+            continue;
+        }
+        if (arg == "--mask-degree" && i + 1 < argc) {
+            options.maskDegree = std::stoi(argv[++i]);
+            continue;
+        }
+        if (arg == "--compact-share") {
+            options.shareFormat = ShareFormat::COMPACT;
+            continue;
+        }
+        if (arg == "--all-towers") {
+            options.reduceTowers = false;
+            continue;
+        }
+        if (arg == "--complex-packing") {
+            options.slotPacking = SlotPacking::COMPLEX;
+            continue;
+        }
+        if (arg == "--noise-sampler" && i + 1 < argc) {
+            std::string kind = argv[++i];
+            if (kind == "cbd") {
+                SetNoiseSampler(NoiseSamplerKind::CENTERED_BINOMIAL);
+            } else if (kind == "gaussian") {
+                SetNoiseSampler(NoiseSamplerKind::GAUSSIAN);
+            } else {
+                std::cerr << "Unknown noise sampler: " << kind << " (expected gaussian or cbd)" << std::endl;
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--agg-tree" && i + 1 < argc) {
+            options.treeCohort = static_cast<uint32_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--agg-fanout" && i + 1 < argc) {
+            options.treeFanOut = static_cast<uint32_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--agg-depth" && i + 1 < argc) {
+            options.treeDepth = static_cast<uint32_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--agg-processes") {
+            options.treeProcesses = true;
+            continue;
+        }
+        if (arg == "--shards" && i + 1 < argc) {
+            const int shards = std::stoi(argv[++i]);
+            if (shards < 1 || shards > MAX_SHARDS) {
+                std::cerr << "--shards needs 1 to " << MAX_SHARDS << " shards, got " << shards << std::endl;
+                return 1;
+            }
+            options.numShards = static_cast<uint32_t>(shards);
+            continue;
+        }
+        if (arg == "--wire-shares") {
+            options.wireShares = true;
+            continue;
+        }
+        if (arg == "--packed-shares") {
+            options.wireShares = true;
+            options.shareEncoding = ShareEncoding::PACKED;
+            continue;
+        }
+        if (arg == "--buffered-aggregation") {
+            options.aggregationMode = AggregationMode::BUFFERED;
+            continue;
+        }
+        if (arg == "--fixed-params") {
+            options.tuneParameters = false;
+            continue;
+        }
+        if (arg == "--precision" && i + 1 < argc) {
+            options.precisionBits = std::stoi(argv[++i]);
+            continue;
+        }
+        if (arg == "--model-size" && i + 1 < argc) {
+            options.modelSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--offline-pool" && i + 1 < argc) {
+            options.offlinePool = std::stoi(argv[++i]);
+            continue;
+        }
+        if (arg == "--rounds" && i + 1 < argc) {
+            options.numRounds = std::stoi(argv[++i]);
+            continue;
+        }
+        std::cerr << "Unknown option: " << arg << "\n"
+                  << "Usage: " << argv[0] << " [--threads N] [--mask-degree K] [--compact-share] [--all-towers] [--fixed-params] [--precision BITS] [--complex-packing] [--model-size D] [--rounds R] [--offline-pool K] [--buffered-aggregation] [--agg-tree N] [--agg-fanout F] [--agg-depth D] [--agg-processes] [--shards S] [--wire-shares] [--packed-shares] [--bench-reduce] [--bench-ecdh] [--verify-mask-graph] [--bench-noise] [--bench-encrypt] [--bench-aggregate] [--bench-ingest] [--bench-wire] [--bench-pack] [--noise-sampler gaussian|cbd]" << std::endl;
+        return 1;
+    }
+    // --rounds, --model-size and --agg-tree each select a different experiment.
+    const int selectedExperiments = (options.numRounds > 1) + (options.modelSize > 0) + (options.treeCohort > 0);
+    if (selectedExperiments > 1) {
+        std::cerr << "--rounds, --model-size and --agg-tree select different experiments; pass only one." << std::endl;
+        return 1;
+    }
+    // Pads are only precomputed between rounds of the multi-round experiment.
+    if (options.offlinePool < 0 || (options.offlinePool > 0 && options.numRounds <= 1)) {
+        std::cerr << "--offline-pool K needs K >= 0 and --rounds R > 1." << std::endl;
+        return 1;
+    }
+    // The multi-round and tree experiments hand shares to their aggregators
+    // unserialized, and the tree folds every share on arrival.
+    if (options.wireShares && (options.numRounds > 1 || options.treeCohort > 0)) {
+        std::cerr << "--wire-shares and --packed-shares cannot be combined with --rounds or --agg-tree." << std::endl;
+        return 1;
+    }
+    if (options.aggregationMode == AggregationMode::BUFFERED && options.treeCohort > 0) {
+        std::cerr << "--buffered-aggregation cannot be combined with --agg-tree." << std::endl;
+        return 1;
+    }
+    // Only Experiments 1, 2 and 4 aggregate through the sharded server, and it
+    // takes the shares as they are (no wire format, no buffering).
+    if (options.numShards > 0 && (options.numRounds > 1 || options.treeCohort > 0 || options.wireShares ||
+                                  options.aggregationMode == AggregationMode::BUFFERED)) {
+        std::cerr << "--shards cannot be combined with --rounds, --agg-tree, --wire-shares, --packed-shares "
+                  << "or --buffered-aggregation." << std::endl;
+        return 1;
+    }
+
     std::cout << "🚀 Starting Secure Aggregation Performance Evaluation Harness" << std::endl;
 
     // --- Setup Log Directory ---
@@ -201,15 +585,81 @@ int main() {
         return 1;
     }
 
-    // --- Setup Log Files ---
+    std::cout << "Simulating clients on " << ResolveThreadCount(options.numThreads) << " thread(s), "
+              << NoiseSamplerName(GetNoiseSampler()) << " noise sampler, "
+              << (options.numShards > 0 ? std::to_string(options.numShards) + "-shard"
+                  : options.aggregationMode == AggregationMode::BUFFERED ? "buffered" : "streaming")
+              << " aggregation." << std::endl;
+
+    // ============================================================================
+    // --- EXPERIMENT 3: MULTI-ROUND TRAINING (only with --rounds R > 1) ---
+    // ============================================================================
+    if (options.numRounds > 1) {
+        std::ofstream rounds_log(log_dir + "/log_rounds.csv");
+        rounds_log << "Experiment,NumClients,DataSize,RingDimension,Round,T_EncryptMean_ms,T_MaskGenMean_ms,T_ClientTotalMax_ms,T_Aggregate_ms,T_Decode_ms,T_RoundWall_ms,T_OfflineMean_ms\n";
+
+        std::ofstream rounds_summary_log(log_dir + "/log_rounds_summary.csv");
+        rounds_summary_log << "Experiment,NumClients,DataSize,RingDimension,NumRounds,T_Setup_ms,T_RoundMean_ms,T_AmortizedRound_ms,OfflinePool,T_OfflineWall_ms\n";
+
+        std::cout << "\n\n=================================================================================="
+                  << "\n--- EXPERIMENT 3: MULTI-ROUND TRAINING (Rounds = " << options.numRounds
+                  << ", Data Size = " << FIXED_DATA_SIZE_FOR_EXP1 << ") ---"
+                  << "\n==================================================================================" << std::endl;
+
+        for (int numClients : CLIENT_COUNTS) {
+            run_multiround_experiment("MultiRound", numClients, FIXED_DATA_SIZE_FOR_EXP1, options, rounds_log, rounds_summary_log);
+        }
+
+        std::cout << "\n\n🎉 Multi-round experiments finished successfully!" << std::endl;
+        return 0;
+    }
+
+    // ============================================================================
+    // --- EXPERIMENT 5: AGGREGATION TREE (only with --agg-tree N) ---
+    // ============================================================================
+    if (options.treeCohort > 0) {
+        std::ofstream tree_log(log_dir + "/log_aggregation_tree.csv");
+        tree_log << "Experiment,NumClients,DataSize,RingDimension,FanOut,Depth,Mode,Level,NumNodes,T_LevelFold_ms,T_LevelComplete_ms,T_RoundWall_ms,T_Decode_ms,ObservedMaxError\n";
+
+        std::cout << "\n\n=================================================================================="
+                  << "\n--- EXPERIMENT 5: AGGREGATION TREE (Cohort = " << options.treeCohort
+                  << ", Data Size = " << TREE_DATA_SIZE << ") ---"
+                  << "\n==================================================================================" << std::endl;
+
+        run_tree_experiment("AggregationTree", static_cast<int>(options.treeCohort), TREE_DATA_SIZE, options, tree_log);
+
+        std::cout << "\n\n🎉 Aggregation-tree experiments finished successfully!" << std::endl;
+        return 0;
+    }
+
+    // --- Setup Log Files (written by Experiments 1, 2 and 4 only) ---
     std::ofstream compute_client_log(log_dir + "/log_computation_client.csv");
     compute_client_log << "Experiment,NumClients,DataSize,RingDimension,ClientID,T_KeyGen_MKCKKS_ms,T_KeyGen_ECDH_ms,T_KeyGen_Total_ms,T_Encrypt_ms,T_MaskGen_ms,T_ClientTotal_ms\n";
     
     std::ofstream compute_server_log(log_dir + "/log_computation_server.csv");
-    compute_server_log << "Experiment,NumClients,DataSize,RingDimension,T_Aggregate_ms,T_Decode_ms,T_ServerTotal_ms\n";
+    compute_server_log << "Experiment,NumClients,DataSize,RingDimension,T_Aggregate_ms,T_Decode_ms,T_ServerTotal_ms,NumThreads,T_ClientPhaseWall_ms,MaskDegree,ScalingModSize,PredictedMaxError,ObservedMaxError,NumShards,ShardAccumulatorBytes,ShardBytesReceived\n";
 
     std::ofstream comm_log(log_dir + "/log_communication_analysis.csv");
-    comm_log << "Experiment,NumClients,DataSize,RingDimension,PlaintextBytes,CiphertextBytes,ClientUplinkBytes,SetupBytes,FinalDownlinkBytes,CiphertextExpansion,CommExpansion\n";
+    comm_log << "Experiment,NumClients,DataSize,RingDimension,PlaintextBytes,CiphertextBytes,ClientUplinkBytes,SetupBytes,FinalDownlinkBytes,CiphertextExpansion,CommExpansion,ShareFormat,UploadTowers,PredictedShareBytes,SlotPacking,NumChunks,CiphertextBytesCereal,ClientUplinkBytesCereal,CiphertextBytesPacked,ClientUplinkBytesPacked\n";
+
+    // ============================================================================
+    // --- EXPERIMENT 4: LARGE MODELS (only with --model-size D) ---
+    // ============================================================================
+    if (options.modelSize > 0) {
+        std::cout << "\n\n=================================================================================="
+                  << "\n--- EXPERIMENT 4: LARGE MODELS (Model Size = " << options.modelSize << ") ---"
+                  << "\n==================================================================================" << std::endl;
+
+        for (int numClients : LARGE_MODEL_CLIENT_COUNTS) {
+            run_experiment("LargeModel", numClients, options.modelSize, options, compute_client_log, compute_server_log, comm_log);
+        }
+
+        compute_client_log.close();
+        compute_server_log.close();
+        comm_log.close();
+        std::cout << "\n\n🎉 Large-model experiments finished successfully!" << std::endl;
+        return 0;
+    }
 
     // ============================================================================
     // --- EXPERIMENT 1: SCALING NUMBER OF CLIENTS ---
@@ -220,7 +670,7 @@ int main() {
     
     for (int numClients : CLIENT_COUNTS) {
         // Call run_experiment with the explicit name for this experiment.
-        run_experiment("ScalingClients", numClients, FIXED_DATA_SIZE_FOR_EXP1, compute_client_log, compute_server_log, comm_log);
+        run_experiment("ScalingClients", numClients, FIXED_DATA_SIZE_FOR_EXP1, options, compute_client_log, compute_server_log, comm_log);
     }
 
     // ============================================================================
@@ -232,7 +682,7 @@ int main() {
 
     for (size_t i = 0; i < DATA_SIZES.size(); ++i) {
         // Call run_experiment with the explicit name for this experiment.
-        run_experiment("ScalingDataSize", FIXED_CLIENT_COUNT_FOR_EXP2, DATA_SIZES[i], compute_client_log, compute_server_log, comm_log);
+        run_experiment("ScalingDataSize", FIXED_CLIENT_COUNT_FOR_EXP2, DATA_SIZES[i], options, compute_client_log, compute_server_log, comm_log);
     }
 
     // --- Cleanup ---
@@ -256,90 +706,128 @@ int main() {
 // CORE EXPERIMENT RUNNER FUNCTION
 // =================================================================================
 void run_experiment(const std::string& experiment_name, int numClients, uint32_t dataSize, 
+                      const HarnessOptions& options,
                       std::ofstream& compute_client_log,
                       std::ofstream& compute_server_log, 
                       std::ofstream& comm_log) {
 
-    uint32_t batchSize = next_power_of_2(dataSize);
-    uint32_t ringDimension;
-    if (batchSize < 16384){
-        ringDimension = 16384;
-    }
-    else{
-        ringDimension = 2 * batchSize;
-    }
-    
-    std::cout << "\n--- Running " << experiment_name 
-              << " with N=" << numClients << ", d=" << dataSize 
-              << ", N_poly=" << ringDimension << " ---" << std::endl;
-    
     // --- A. Per-Run CryptoContext Generation ---
-    CCParams<CryptoContextCKKSRNS> parameters;
-    parameters.SetRingDim(ringDimension);
-    parameters.SetMultiplicativeDepth(1);
-    parameters.SetScalingModSize(50);
-    parameters.SetBatchSize(batchSize);
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
-    cc->Enable(PKE);
+    std::cout << "\n--- Running " << experiment_name
+              << " with N=" << numClients << ", d=" << dataSize << " ---" << std::endl;
+    TunedParameters tuned = make_experiment_context(numClients, dataSize, options);
+    CryptoContext<DCRTPoly> cc = tuned.cc;
+    uint32_t ringDimension = tuned.ringDim;
+    uint32_t upload_towers = tuned.uploadTowers;
 
     // --- B. Setup: Create Clients, Server, and Generate All Keys ---
     DCRTPoly crs_a = GenerateCRS(cc);
-    Server server;
     std::vector<Client> clients;
     clients.reserve(numClients);
     
+    int numThreads = ResolveThreadCount(options.numThreads);
+    // By default shares are folded into the server's per-chunk accumulators as
+    // they arrive, so the server holds one polynomial per chunk and client
+    // thread regardless of numClients. Each thread owns its accumulators.
+    // With --shards S the shares go to S aggregator processes instead, each
+    // summing 1/S of every share's words. Only the aggregator in use is built.
+    std::unique_ptr<Server> server;
+    std::unique_ptr<ShardedServer> sharded_server;
+    if (options.numShards > 0) {
+        sharded_server = std::make_unique<ShardedServer>(options.numShards, tuned.numChunks);
+    } else {
+        server = std::make_unique<Server>(options.aggregationMode, tuned.numChunks, numThreads);
+    }
+    const uint64_t context_id = WireContextId(cc);
+    if (server && options.wireShares) {
+        server->setWireContext(cc->GetCryptoParameters()->GetElementParams(), context_id);
+    }
+
     std::cout << "Generating keys for all " << numClients << " clients..." << std::endl;
     for (int i = 0; i < numClients; ++i) {
         clients.emplace_back(i);
-        clients[i].generateKeys(cc, crs_a);
+        clients.back().setShareFormat(options.shareFormat);
+        clients.back().setSlotPacking(options.slotPacking);
+        clients.back().setUploadTowers(upload_towers);
     }
+    ParallelFor(numClients, numThreads, [&](int i) {
+        clients[i].generateKeys(cc, crs_a);
+    });
     
-    std::map<uint32_t, ECDHPublicKey> allPublicKeys;
-    for (const auto& client : clients) {
-        allPublicKeys[client.getId()] = client.getECDHPublicKey();
-    }
-    std::cout << "Setup and KeyGen complete." << std::endl;
+    // Broadcast the raw key directory; all client threads share the parsed keys read-only.
+    size_t setup_bytes = 0;
+    PeerKeyDirectory peerKeys = broadcast_public_keys(clients, setup_bytes);
+    MaskingGraph graph = make_masking_graph(numClients, options);
+    std::cout << "Setup and KeyGen complete (masking degree " << graph.degree() << ")." << std::endl;
 
     ClientShare representative_share;
-    ClientTimings last_client_timings;
-
-    // --- C & F. STREAMING: Process, Aggregate, and Log One Client at a Time ---
+    std::vector<ClientTimings> client_timings(numClients);
+
+    // --- C. PARALLEL STREAMING: Each thread prepares its block of clients and
+    // immediately folds every chunk share into its own server stripe, so only
+    // one in-flight chunk per thread is ever held in memory. Updates that fit
+    // one ciphertext are simply a single chunk.
+    auto phase_start = std::chrono::high_resolution_clock::now();
+    ParallelFor(numClients, numThreads, [&](int i) {
+        clients[i].generateData(dataSize, -CLIENT_DATA_MAX_ABS, CLIENT_DATA_MAX_ABS);
+        client_timings[i] = clients[i].prepareTensorShares(cc, peerKeys, graph, [&](ClientShare& share) {
+            if (sharded_server) {
+                sharded_server->collectShare(share);
+            } else if (options.wireShares) {
+                // One reusable send buffer per thread, as a client's socket buffer would be.
+                thread_local std::vector<uint8_t> wire_buffer;
+                SerializeShareWire(share, context_id, wire_buffer, options.shareEncoding);
+                server->collectShare(ShareWireView(wire_buffer.data(), wire_buffer.size()), CurrentThreadIndex());
+            } else {
+                server->collectShare(share, CurrentThreadIndex());
+            }
+            if (i == 0 && share.chunkIndex == 0) {
+                representative_share = std::move(share);
+            }
+        });
+    });
+    double client_phase_wall_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - phase_start).count();
+    std::cout << "All clients have prepared and sent shares (" << client_phase_wall_ms
+              << " ms wall-clock on " << numThreads << " thread(s))." << std::endl;
+
+    // --- F. Log per-client timing data in client order, using the explicit experiment_name.
     for (int i = 0; i < numClients; ++i) {
-        clients[i].generateData(dataSize, -999.0, 999.0);
-        ClientResult client_result = clients[i].prepareShareForServer(cc, allPublicKeys);
-        server.collectShare(client_result.share);
-        
-        if (i == 0) {
-            representative_share = client_result.share;
-        }
-
-        last_client_timings = client_result.timings;
-        
-        // Log timing data using the explicit experiment_name.
+        const ClientTimings& t = client_timings[i];
         compute_client_log << experiment_name << "," << numClients << "," << dataSize << "," << ringDimension << "," << i << ","
-                             << last_client_timings.key_gen.t_mkckks_ms << ","
-                             << last_client_timings.key_gen.t_ecdh_ms << ","
-                             << last_client_timings.key_gen.t_total_ms << ","
-                             << last_client_timings.t_encrypt_ms << ","
-                             << last_client_timings.t_mask_gen_ms << ","
-                             << last_client_timings.t_client_total_ms << std::endl;
+                             << t.key_gen.t_mkckks_ms << ","
+                             << t.key_gen.t_ecdh_ms << ","
+                             << t.key_gen.t_total_ms << ","
+                             << t.t_encrypt_ms << ","
+                             << t.t_mask_gen_ms << ","
+                             << t.t_client_total_ms << std::endl;
     }
-    std::cout << "All clients have prepared and sent shares." << std::endl;
+    const ClientTimings& last_client_timings = client_timings.back();
 
     // --- D. Server-Side Computation & Timing ---
-    ServerResult server_result = server.getFinalResult(cc, dataSize);
+    ServerResult server_result = sharded_server
+        ? sharded_server->getFinalResult(cc, dataSize, options.slotPacking)
+        : server->getFinalResult(cc, dataSize, options.slotPacking);
     server_result.timings.t_server_total_ms = server_result.timings.t_aggregate_ms + server_result.timings.t_decode_ms;
     std::cout << "Server has aggregated and decoded the final result." << std::endl;
+    // Per-node cost of the largest shard (what each aggregator must hold and receive).
+    size_t shard_accumulator_bytes = 0, shard_bytes_received = 0;
+    if (sharded_server) {
+        for (const ShardStats& stats : sharded_server->getShardStats()) {
+            shard_accumulator_bytes = std::max(shard_accumulator_bytes, stats.accumulatorBytes);
+            shard_bytes_received = std::max(shard_bytes_received, stats.bytesReceived);
+        }
+    }
+    double observed_error = max_aggregate_error(clients, server_result.final_aggregated_vector);
 
     // --- E. COMMUNICATION COST ANALYSIS ---
     size_t plaintext_bytes = dataSize * sizeof(double);
     size_t ciphertext_bytes = get_mkciphertext_size(cc, crs_a);
-    size_t client_uplink_bytes = get_client_share_size(representative_share);
-    size_t setup_bytes = 0;
-
-    for (const auto& pair : allPublicKeys) {
-        setup_bytes += pair.second.size();
-    }
+    // Every chunk share has the same size.
+    size_t client_uplink_bytes = tuned.numChunks * get_client_share_size(representative_share);
+    size_t ciphertext_bytes_cereal = get_mkciphertext_cereal_size(cc, crs_a);
+    size_t client_uplink_bytes_cereal = tuned.numChunks * get_client_share_cereal_size(representative_share);
+    size_t ciphertext_bytes_packed = get_mkciphertext_size(cc, crs_a, ShareEncoding::PACKED);
+    size_t client_uplink_bytes_packed = tuned.numChunks * get_client_share_size(representative_share, ShareEncoding::PACKED);
 
     size_t final_downlink_bytes = server_result.final_aggregated_vector.size() * sizeof(double);
     double ciphertext_expansion = (double)ciphertext_bytes / plaintext_bytes;
@@ -350,19 +838,278 @@ void run_experiment(const std::string& experiment_name, int numClients, uint32_t
     compute_server_log << experiment_name << "," << numClients << "," << dataSize << "," << ringDimension << ","
                        << server_result.timings.t_aggregate_ms << ","
                        << server_result.timings.t_decode_ms << ","
-                       << server_result.timings.t_server_total_ms << std::endl;
+                       << server_result.timings.t_server_total_ms << ","
+                       << numThreads << "," << client_phase_wall_ms << "," << graph.degree() << ","
+                       << tuned.scalingModSize << "," << tuned.predictedMaxError << "," << observed_error << ","
+                       << options.numShards << "," << shard_accumulator_bytes << "," << shard_bytes_received << std::endl;
 
     comm_log << experiment_name << "," << numClients << "," << dataSize << "," << ringDimension << ","
              << plaintext_bytes << "," << ciphertext_bytes << "," << client_uplink_bytes << ","
              << setup_bytes << "," << final_downlink_bytes << ","
-             << ciphertext_expansion << "," << comm_expansion << std::endl;
+             << ciphertext_expansion << "," << comm_expansion << ","
+             << share_format_name(options.shareFormat) << "," << upload_towers << ","
+             << tuned.predictedShareBytes << "," << slot_packing_name(options.slotPacking) << ","
+             << tuned.numChunks << "," << ciphertext_bytes_cereal << "," << client_uplink_bytes_cereal << ","
+             << ciphertext_bytes_packed << "," << client_uplink_bytes_packed << std::endl;
     
     // --- G. CONSOLE SUMMARY ---
     std::cout << "  Computation Summary (Last Client):\n"
               << "    - T_Encrypt: " << last_client_timings.t_encrypt_ms << " ms\n"
               << "    - T_MaskGen: " << last_client_timings.t_mask_gen_ms << " ms\n";
+    std::cout << "  Accuracy: max error " << format_error(observed_error)
+              << " (predicted " << format_error(tuned.predictedMaxError) << ")\n";
     std::cout << "  Communication Cost Summary:\n"
-              << "    - Client Uplink Share Size: " << (client_uplink_bytes / 1024.0) << " KB\n"
+              << "    - Client Uplink Share Size: " << (client_uplink_bytes / 1024.0) << " KB ("
+              << share_format_name(options.shareFormat) << " share, " << upload_towers << " towers; "
+              << (client_uplink_bytes_packed / 1024.0) << " KB bit-packed)\n"
               << "    - Ciphertext Expansion Factor: " << std::fixed << std::setprecision(2) << ciphertext_expansion << "x\n"
               << "    - Communication Expansion Factor: " << comm_expansion << "x\n";
-}
\ No newline at end of file
+    if (sharded_server) {
+        std::cout << "  Sharded Aggregation: " << options.numShards << " shards, largest holds "
+                  << (shard_accumulator_bytes / 1024.0) << " KB and received "
+                  << (shard_bytes_received / 1024.0) << " KB\n";
+    }
+}
+
+
+
+// =================================================================================
+// MULTI-ROUND EXPERIMENT RUNNER FUNCTION
+// =================================================================================
+// Sets up the context, CRS, keys and pairwise secrets once, then runs
+// options.numRounds aggregation rounds with the same cohort. Each round only
+// pays for encryption, the per-round seed KDF, PRG expansion and aggregation.
+void run_multiround_experiment(const std::string& experiment_name, int numClients, uint32_t dataSize,
+                               const HarnessOptions& options,
+                               std::ofstream& rounds_log, std::ofstream& rounds_summary_log) {
+    auto elapsed_ms = [](std::chrono::high_resolution_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    int numThreads = ResolveThreadCount(options.numThreads);
+
+    // --- A. One-Time Setup: Context, CRS, Keys and Pairwise Secrets ---
+    auto setup_start = std::chrono::high_resolution_clock::now();
+    std::cout << "\n--- Running " << experiment_name
+              << " with N=" << numClients << ", d=" << dataSize
+              << ", R=" << options.numRounds << " ---" << std::endl;
+    TunedParameters tuned = make_experiment_context(numClients, dataSize, options);
+    CryptoContext<DCRTPoly> cc = tuned.cc;
+    uint32_t ringDimension = tuned.ringDim;
+    uint32_t upload_towers = tuned.uploadTowers;
+
+    DCRTPoly crs_a = GenerateCRS(cc);
+    std::vector<Client> clients;
+    clients.reserve(numClients);
+    for (int i = 0; i < numClients; ++i) {
+        clients.emplace_back(i);
+        clients.back().setShareFormat(options.shareFormat);
+        clients.back().setSlotPacking(options.slotPacking);
+        clients.back().setUploadTowers(upload_towers);
+    }
+    ParallelFor(numClients, numThreads, [&](int i) {
+        clients[i].generateKeys(cc, crs_a);
+    });
+
+    size_t setup_bytes = 0;
+    PeerKeyDirectory peerKeys = broadcast_public_keys(clients, setup_bytes);
+    MaskingGraph graph = make_masking_graph(numClients, options);
+    ParallelFor(numClients, numThreads, [&](int i) {
+        clients[i].establishPairwiseSecrets(peerKeys, graph);
+    });
+    double setup_ms = elapsed_ms(setup_start);
+    std::cout << "One-time setup complete (" << setup_ms << " ms, " << setup_bytes
+              << " bytes of broadcast keys)." << std::endl;
+
+    // Offline/online split: every client keeps `pool` rounds of masked
+    // encryption pads buffered. This work is done while clients are idle, so it
+    // is timed separately from the round latency.
+    const int pool = std::min(options.offlinePool, options.numRounds);
+    double offline_wall_ms = 0.0;
+    auto refill_pools = [&](int firstRound, int count) {
+        if (count <= 0) return;
+        auto offline_start = std::chrono::high_resolution_clock::now();
+        ParallelFor(numClients, numThreads, [&](int i) {
+            clients[i].precomputeRounds(static_cast<uint32_t>(firstRound), static_cast<uint32_t>(count));
+        });
+        offline_wall_ms += elapsed_ms(offline_start);
+    };
+    if (pool > 0) {
+        refill_pools(0, pool);
+        std::cout << "Precomputed " << pool << " round(s) of encryption pads per client (" << offline_wall_ms
+                  << " ms offline)." << std::endl;
+    }
+
+    // --- B. Round Loop ---
+    Server server(options.aggregationMode, 1, numThreads);
+    double total_round_ms = 0.0;
+    for (int round = 0; round < options.numRounds; ++round) {
+        auto round_start = std::chrono::high_resolution_clock::now();
+        std::vector<ClientTimings> client_timings(numClients);
+
+        ParallelFor(numClients, numThreads, [&](int i) {
+            clients[i].generateData(dataSize, -CLIENT_DATA_MAX_ABS, CLIENT_DATA_MAX_ABS);
+            ClientResult client_result = (pool > 0)
+                ? clients[i].prepareShareOnline(cc, static_cast<uint32_t>(round))
+                : clients[i].prepareShareForRound(cc, static_cast<uint32_t>(round));
+            server.collectShare(client_result.share, CurrentThreadIndex());
+            client_timings[i] = client_result.timings;
+        });
+
+        ServerResult server_result = server.getFinalResult(cc, dataSize, options.slotPacking);
+        server.reset();
+        double round_ms = elapsed_ms(round_start);
+        total_round_ms += round_ms;
+
+        // Top the pools back up for round + pool while the clients are idle.
+        if (pool > 0 && round + pool < options.numRounds) {
+            refill_pools(round + pool, 1);
+        }
+
+        double encrypt_mean = 0.0, mask_mean = 0.0, client_max = 0.0, offline_mean = 0.0;
+        for (const ClientTimings& t : client_timings) {
+            encrypt_mean += t.t_encrypt_ms;
+            mask_mean += t.t_mask_gen_ms;
+            client_max = std::max(client_max, t.t_client_total_ms);
+            offline_mean += t.t_offline_ms;
+        }
+        encrypt_mean /= numClients;
+        mask_mean /= numClients;
+        offline_mean /= numClients;
+
+        rounds_log << experiment_name << "," << numClients << "," << dataSize << "," << ringDimension << "," << round << ","
+                   << encrypt_mean << "," << mask_mean << "," << client_max << ","
+                   << server_result.timings.t_aggregate_ms << ","
+                   << server_result.timings.t_decode_ms << ","
+                   << round_ms << "," << offline_mean << std::endl;
+    }
+
+    // --- C. Amortized Summary ---
+    double round_mean_ms = total_round_ms / options.numRounds;
+    double amortized_ms = (setup_ms + offline_wall_ms + total_round_ms) / options.numRounds;
+    rounds_summary_log << experiment_name << "," << numClients << "," << dataSize << "," << ringDimension << ","
+                       << options.numRounds << "," << setup_ms << "," << round_mean_ms << "," << amortized_ms << ","
+                       << pool << "," << offline_wall_ms << std::endl;
+
+    std::cout << "  Multi-Round Summary:\n"
+              << "    - One-time setup: " << setup_ms << " ms\n"
+              << "    - Offline precomputation (pool " << pool << "): " << offline_wall_ms << " ms\n"
+              << "    - Mean per-round: " << round_mean_ms << " ms\n"
+              << "    - Amortized per-round (incl. setup and offline): " << amortized_ms << " ms" << std::endl;
+}
+
+
+
+// =================================================================================
+// AGGREGATION TREE EXPERIMENT RUNNER FUNCTION
+// =================================================================================
+// Sets up one cohort (context, keys, masking graph) once, then runs one round
+// per tree shape: every client's share enters at a level-1 aggregator, and
+// each aggregator forwards one partial share to its parent. With
+// --agg-processes every subtree below the root runs in its own process and
+// only its partial crosses the process boundary. Logs one row per tree level.
+void run_tree_experiment(const std::string& experiment_name, int numClients, uint32_t dataSize,
+                         const HarnessOptions& options, std::ofstream& tree_log) {
+    // Forked subtrees must not share OpenFHE's inherited PRNG state. Threads
+    // use the same sampler, so both modes pay the same noise cost.
+    UsePrgGaussianSampler();
+    std::cout << "\n--- Running " << experiment_name
+              << " with N=" << numClients << ", d=" << dataSize << " ---" << std::endl;
+    TunedParameters tuned = make_experiment_context(numClients, dataSize, options);
+    CryptoContext<DCRTPoly> cc = tuned.cc;
+    int numThreads = ResolveThreadCount(options.numThreads);
+
+    // --- A. One-Time Setup ---
+    DCRTPoly crs_a = GenerateCRS(cc);
+    std::vector<Client> clients;
+    clients.reserve(numClients);
+    for (int i = 0; i < numClients; ++i) {
+        clients.emplace_back(i);
+        clients.back().setShareFormat(options.shareFormat);
+        clients.back().setSlotPacking(options.slotPacking);
+        clients.back().setUploadTowers(tuned.uploadTowers);
+    }
+    ParallelFor(numClients, numThreads, [&](int i) {
+        clients[i].generateKeys(cc, crs_a);
+    });
+    size_t setup_bytes = 0;
+    PeerKeyDirectory peerKeys = broadcast_public_keys(clients, setup_bytes);
+    HarnessOptions graph_options = options;
+    if (graph_options.maskDegree <= 0) graph_options.maskDegree = TREE_DEFAULT_MASK_DEGREE;
+    MaskingGraph graph = make_masking_graph(numClients, graph_options);
+    std::cout << "Setup and KeyGen complete (masking degree " << graph.degree() << ")." << std::endl;
+
+    // --- B. Tree Shapes ---
+    std::vector<std::pair<uint32_t, uint32_t>> shapes; // (fanOut, depth)
+    if (options.treeDepth > 0) {
+        shapes.emplace_back(AggregationTree::FanOutFor(numClients, options.treeDepth), options.treeDepth);
+    } else if (options.treeFanOut > 0) {
+        shapes.emplace_back(options.treeFanOut, 0);
+    } else {
+        for (uint32_t fanOut : TREE_FAN_OUTS) {
+            shapes.emplace_back(fanOut == 0 ? std::max(2, numClients) : fanOut, 0);
+        }
+    }
+
+    for (const auto& shape : shapes) {
+        AggregationTree tree(numClients, shape.first, tuned.numChunks, shape.second);
+        // Subtree processes need at least one level below the root.
+        const bool processes = options.treeProcesses && tree.getDepth() >= 2;
+        ParallelFor(numClients, numThreads, [&](int i) {
+            clients[i].generateData(dataSize, -CLIENT_DATA_MAX_ABS, CLIENT_DATA_MAX_ABS);
+        });
+
+        // --- C. One Round Through the Tree ---
+        std::vector<ClientTimings> client_timings(numClients);
+        auto round_start = std::chrono::high_resolution_clock::now();
+        tree.start();
+        if (processes) {
+            RunSubtreesInProcesses(tree,
+                [&](uint32_t subtree, AggregationTree& local) {
+                    uint32_t first, count;
+                    tree.getLeafRange(tree.getDepth() - 1, subtree, first, count);
+                    std::vector<ClientTimings> timings(count);
+                    for (uint32_t j = 0; j < count; ++j) {
+                        timings[j] = clients[first + j].prepareTensorShares(cc, peerKeys, graph, [&](ClientShare& share) {
+                            local.collectShare(j, share);
+                        });
+                    }
+                    return std::string(reinterpret_cast<const char*>(timings.data()), count * sizeof(ClientTimings));
+                },
+                [&](uint32_t subtree, const std::string& blob) {
+                    uint32_t first, count;
+                    tree.getLeafRange(tree.getDepth() - 1, subtree, first, count);
+                    std::memcpy(&client_timings[first], blob.data(), std::min<size_t>(blob.size(), count * sizeof(ClientTimings)));
+                });
+        } else {
+            ParallelFor(numClients, numThreads, [&](int i) {
+                client_timings[i] = clients[i].prepareTensorShares(cc, peerKeys, graph, [&](ClientShare& share) {
+                    tree.collectShare(static_cast<uint32_t>(i), share);
+                });
+            });
+        }
+        ServerResult result = tree.getFinalResult(cc, dataSize, options.slotPacking);
+        double round_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - round_start).count();
+        double observed_error = max_aggregate_error(clients, result.final_aggregated_vector);
+
+        // --- D. Logging (one row per level) ---
+        const char* mode = processes ? "Processes" : "Threads";
+        for (const AggregationLevelTimings& level : tree.getLevelTimings()) {
+            tree_log << experiment_name << "," << numClients << "," << dataSize << "," << tuned.ringDim << ","
+                     << tree.getFanOut() << "," << tree.getDepth() << "," << mode << ","
+                     << level.level << "," << level.numNodes << "," << level.foldMs << "," << level.completeMs << ","
+                     << round_ms << "," << result.timings.t_decode_ms << "," << observed_error << std::endl;
+        }
+
+        double encrypt_mean_ms = 0.0;
+        for (const ClientTimings& t : client_timings) encrypt_mean_ms += t.t_encrypt_ms;
+        encrypt_mean_ms /= numClients;
+        std::cout << "  Fan-out " << tree.getFanOut() << ", depth " << tree.getDepth() << " (" << mode << "): round "
+                  << round_ms << " ms, mean T_Encrypt " << encrypt_mean_ms << " ms, max error "
+                  << format_error(observed_error) << std::endl;
+        for (const AggregationLevelTimings& level : tree.getLevelTimings()) {
+            std::cout << "    - Level " << level.level << ": " << level.numNodes << " node(s), fold "
+                      << level.foldMs << " ms, complete at " << level.completeMs << " ms" << std::endl;
+        }
+    }
+}
@@ -5,13 +5,19 @@
 // such that the sum of all masks across the system is zero.
 
 #include "masking.h"
+#include "reduce_kernels.h"
+#include "parallel.h"
 #include <openssl/evp.h>
 #include <openssl/ec.h>
 #include <openssl/kdf.h>
 #include <openssl/pem.h>
 #include <stdexcept>
 #include <algorithm> // For std::min
+#include <cstring>   // For std::memset
+#include <limits>    // For std::numeric_limits
 #include <vector>
+#include <numeric>   // For std::iota
+#include <random>    // For std::mt19937_64
 
 // --- Implementation of the EVP_PKEY_Deleter for smart pointers ---
 // This enables SafePKey (std::unique_ptr) to automatically manage the memory
@@ -89,6 +95,34 @@ SafePKey DeserializePublicKey(const ECDHPublicKey& pubKeyBytes) {
     return SafePKey(pkey);
 }
 
+/**
+ * @brief Exports the raw 32-byte X25519 public key, without any DER framing.
+ * This is the entry format of the compact RawKeyDirectory.
+ * @param keys A SafePKey containing the key pair.
+ * @return A byte vector holding exactly RawKeyDirectory::KEY_BYTES bytes.
+ */
+ECDHPublicKey SerializeRawPublicKey(const SafePKey& keys) {
+    ECDHPublicKey raw(RawKeyDirectory::KEY_BYTES);
+    size_t len = raw.size();
+    if (EVP_PKEY_get_raw_public_key(keys.get(), raw.data(), &len) <= 0 || len != raw.size()) {
+        throw std::runtime_error("Failed to export raw public key");
+    }
+    return raw;
+}
+
+/**
+ * @brief Builds an X25519 public key object directly from its 32 raw bytes.
+ * @param rawKey Pointer to RawKeyDirectory::KEY_BYTES bytes.
+ * @return A SafePKey holding the public key.
+ */
+SafePKey LoadRawPublicKey(const unsigned char* rawKey) {
+    EVP_PKEY* pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, rawKey, RawKeyDirectory::KEY_BYTES);
+    if (!pkey) {
+        throw std::runtime_error("Failed to load raw public key");
+    }
+    return SafePKey(pkey);
+}
+
 /**
  * @brief Computes a shared secret using my private key and a peer's public key (ECDH).
  * This function is generic and works for X25519 keys as well.
@@ -132,69 +166,268 @@ std::vector<unsigned char> ComputeSharedSecret(const SafePKey& myKeys, const Saf
 }
 
 /**
- * @brief Uses a seed to generate a pseudo-random DCRTPoly for masking.
- *
- * This function takes a seed (derived from an ECDH shared secret) and uses it
- * as a key for the ChaCha20 stream cipher. The cipher's output is a long stream
- * of pseudo-random bytes, which are then interpreted as coefficients to form a
- * polynomial. Crucially, each generated coefficient is reduced modulo the
- * correct prime for its ring dimension to ensure it is a valid member.
- *
- * @param seed The input seed (byte vector).
- * @param cc The crypto context, needed for polynomial parameters.
- * @return A pseudo-random polynomial in DCRTPoly format.
+ * @brief Parses every public key in the map exactly once.
+ * @param allPublicKeys A map of all client IDs to their serialized public keys.
  */
-DCRTPoly PRGToDCRTPoly(const std::vector<unsigned char>& seed, CryptoContext<DCRTPoly>& cc) {
-    auto params = cc->GetCryptoParameters()->GetElementParams();
-    
-    // Use ChaCha20 to expand the seed into a long stream of random bytes.
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    const EVP_CIPHER* cipher = EVP_chacha20();
-    unsigned char key[32] = {0}; // ChaCha20 uses a 256-bit key.
-    unsigned char iv[16] = {0};  // and a 128-bit IV/nonce.
-
-    // Use the beginning of the shared secret as the key.
-    size_t len_to_copy = std::min(seed.size(), sizeof(key));
-    std::copy(seed.begin(), seed.begin() + len_to_copy, key);
-
-    // Calculate the total number of bytes needed to fill the entire DCRTPoly.
-    size_t bytes_per_tower = params->GetRingDimension() * sizeof(uint64_t);
-    size_t total_bytes = params->GetParams().size() * bytes_per_tower;
-    std::vector<unsigned char> random_bytes(total_bytes);
-
-    // "Encrypt" a zero buffer to get a pseudo-random stream from ChaCha20.
-    int out_len;
-    EVP_EncryptInit_ex(ctx, cipher, NULL, key, iv);
-    EVP_EncryptUpdate(ctx, random_bytes.data(), &out_len, random_bytes.data(), random_bytes.size());
-    EVP_CIPHER_CTX_free(ctx);
-
-    // Create a DCRTPoly and fill it from the generated random bytes.
-    DCRTPoly random_poly(params, Format::EVALUATION, true);
-    uint64_t* random_uints = reinterpret_cast<uint64_t*>(random_bytes.data());
-    size_t uints_offset = 0;
-
-    // Iterate through each tower (each prime modulus in the RNS representation).
-    for (size_t i = 0; i < params->GetParams().size(); ++i) {
-        auto tower_params = params->GetParams()[i];
-        NativeVector tower_vec(params->GetRingDimension(), tower_params->GetModulus());
-        const NativeInteger& modulus = tower_params->GetModulus();
-        
-        for (size_t j = 0; j < params->GetRingDimension(); ++j) {
-            tower_vec[j] = NativeInteger(random_uints[uints_offset + j]) % modulus;
+PeerKeyDirectory::PeerKeyDirectory(const std::map<uint32_t, ECDHPublicKey>& allPublicKeys) {
+    m_ids.reserve(allPublicKeys.size());
+    m_keys.reserve(allPublicKeys.size());
+    for (const auto& pair : allPublicKeys) {
+        m_ids.push_back(pair.first);
+        m_keys.push_back(DeserializePublicKey(pair.second));
+    }
+}
+
+/**
+ * @brief Loads every key from a raw directory; client IDs are the directory indices.
+ * @param rawKeys A RawKeyDirectory, typically memory-mapped from the broadcast file.
+ */
+PeerKeyDirectory::PeerKeyDirectory(const RawKeyDirectory& rawKeys) {
+    m_ids.reserve(rawKeys.size());
+    m_keys.reserve(rawKeys.size());
+    for (uint32_t id = 0; id < rawKeys.size(); ++id) {
+        m_ids.push_back(id);
+        m_keys.push_back(LoadRawPublicKey(rawKeys.keyAt(id)));
+    }
+}
+
+size_t PeerKeyDirectory::indexOf(uint32_t id) const {
+    auto it = std::lower_bound(m_ids.begin(), m_ids.end(), id);
+    if (it == m_ids.end() || *it != id) {
+        throw std::out_of_range("Client ID not found in the peer key directory");
+    }
+    return static_cast<size_t>(it - m_ids.begin());
+}
+
+// =================================================================================
+// MASKING GRAPH
+// =================================================================================
+
+MaskingGraph MaskingGraph::Complete(uint32_t numClients) {
+    MaskingGraph graph;
+    graph.m_numClients = numClients;
+    graph.m_degree = numClients > 0 ? numClients - 1 : 0;
+    return graph;
+}
+
+MaskingGraph MaskingGraph::KRegular(uint32_t numClients, uint32_t k, uint64_t publicSeed) {
+    k += k % 2;
+    if (numClients < 2 || k >= numClients - 1) {
+        return Complete(numClients);
+    }
+
+    MaskingGraph graph;
+    graph.m_numClients = numClients;
+    graph.m_degree = k;
+
+    // Fisher-Yates with an explicitly specified engine (std::shuffle's algorithm
+    // is implementation-defined), so every client derives the same permutation.
+    std::mt19937_64 prng(publicSeed);
+    graph.m_permutation.resize(numClients);
+    std::iota(graph.m_permutation.begin(), graph.m_permutation.end(), 0u);
+    for (uint32_t i = numClients - 1; i > 0; --i) {
+        uint32_t j = static_cast<uint32_t>(prng() % (static_cast<uint64_t>(i) + 1));
+        std::swap(graph.m_permutation[i], graph.m_permutation[j]);
+    }
+    graph.m_position.resize(numClients);
+    for (uint32_t pos = 0; pos < numClients; ++pos) {
+        graph.m_position[graph.m_permutation[pos]] = pos;
+    }
+    return graph;
+}
+
+std::vector<uint32_t> MaskingGraph::neighbours(uint32_t id) const {
+    std::vector<uint32_t> result;
+    if (isComplete()) {
+        result.reserve(m_degree);
+        for (uint32_t peer = 0; peer < m_numClients; ++peer) {
+            if (peer != id) result.push_back(peer);
         }
+        return result;
+    }
+
+    // The k/2 ring positions on either side; symmetric by construction.
+    result.reserve(m_degree);
+    uint32_t pos = m_position[id];
+    for (uint32_t d = 1; d <= m_degree / 2; ++d) {
+        result.push_back(m_permutation[(pos + d) % m_numClients]);
+        result.push_back(m_permutation[(pos + m_numClients - d) % m_numClients]);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+namespace {
+
+// A derivation context bound to one private key, reused for many peers: only
+// the peer is re-set between derivations, instead of allocating and
+// initializing a fresh EVP_PKEY_CTX for every shared secret.
+class ECDHDeriver {
+public:
+    explicit ECDHDeriver(const SafePKey& myKeys) : m_ctx(EVP_PKEY_CTX_new(myKeys.get(), NULL)) {
+        if (!m_ctx) throw std::runtime_error("Failed to create EVP_PKEY_CTX for derivation");
+        if (EVP_PKEY_derive_init(m_ctx) <= 0) {
+            EVP_PKEY_CTX_free(m_ctx);
+            throw std::runtime_error("Failed to initialize derivation");
+        }
+    }
+    ~ECDHDeriver() { EVP_PKEY_CTX_free(m_ctx); }
+    ECDHDeriver(const ECDHDeriver&) = delete;
+    ECDHDeriver& operator=(const ECDHDeriver&) = delete;
+
+    std::vector<unsigned char> derive(EVP_PKEY* peerPubKey) {
+        if (EVP_PKEY_derive_set_peer(m_ctx, peerPubKey) <= 0) {
+            throw std::runtime_error("Failed to set peer public key");
+        }
+        size_t secret_len;
+        if (EVP_PKEY_derive(m_ctx, NULL, &secret_len) <= 0) {
+            throw std::runtime_error("Failed to determine secret length");
+        }
+        std::vector<unsigned char> secret(secret_len);
+        if (EVP_PKEY_derive(m_ctx, secret.data(), &secret_len) <= 0) {
+            throw std::runtime_error("Failed to derive secret");
+        }
+        secret.resize(secret_len);
+        return secret;
+    }
 
-        NativePoly tower_poly(tower_params);
-        tower_poly.SetValues(std::move(tower_vec), Format::EVALUATION);
-        random_poly.SetElementAtIndex(i, std::move(tower_poly));
+private:
+    EVP_PKEY_CTX* m_ctx;
+};
 
-        uints_offset += params->GetRingDimension();
+// Every client ID in the directory except `myId`, in ascending order.
+std::vector<uint32_t> AllPeerIds(uint32_t myId, const PeerKeyDirectory& peerKeys) {
+    std::vector<uint32_t> ids;
+    ids.reserve(peerKeys.size());
+    for (size_t k = 0; k < peerKeys.size(); ++k) {
+        if (peerKeys.idAt(k) != myId) ids.push_back(peerKeys.idAt(k)); // Skip self.
     }
-    return random_poly;
+    return ids;
 }
 
+} // namespace
+
+// Number of 64-bit keystream words produced per ChaCha20 call. 4096 words
+// (32 KB) stay cache-resident while they are reduced and accumulated. This is
+// also the unit of parallel work: one chunk of one tower, for every peer.
+constexpr size_t PRG_CHUNK_WORDS = 4096;
+
+// ChaCha20 emits 64-byte blocks, i.e. 8 keystream words per block counter step.
+constexpr size_t CHACHA_WORDS_PER_BLOCK = 64 / sizeof(uint64_t);
+
+namespace {
+
+// One pairwise PRG stream to fold into a mask: its ChaCha20 key and its sign.
+struct MaskSeed {
+    unsigned char key[32];
+    bool subtract;
+};
+
+MaskSeed MakeMaskSeed(const std::vector<unsigned char>& seed, bool subtract) {
+    MaskSeed ms{};
+    // Use the beginning of the shared secret as the 256-bit ChaCha20 key.
+    size_t len_to_copy = std::min(seed.size(), sizeof(ms.key));
+    std::copy(seed.begin(), seed.begin() + len_to_copy, ms.key);
+    ms.subtract = subtract;
+    return ms;
+}
+
+/**
+ * Positions a ChaCha20 context at keystream word `startWord` of `key`'s stream.
+ * OpenSSL's 16-byte IV is a little-endian 32-bit block counter followed by the
+ * nonce (all zero here), so any block-aligned position can be reached directly.
+ */
+void SeekKeystream(EVP_CIPHER_CTX* ctx, const unsigned char* key, uint64_t startWord) {
+    uint64_t block = startWord / CHACHA_WORDS_PER_BLOCK;
+    if (block > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("Mask keystream offset exceeds the ChaCha20 block counter");
+    }
+    uint32_t counter = static_cast<uint32_t>(block);
+    unsigned char iv[16] = {0};
+    iv[0] = static_cast<unsigned char>(counter);
+    iv[1] = static_cast<unsigned char>(counter >> 8);
+    iv[2] = static_cast<unsigned char>(counter >> 16);
+    iv[3] = static_cast<unsigned char>(counter >> 24);
+    if (EVP_EncryptInit_ex(ctx, EVP_chacha20(), NULL, key, iv) <= 0) {
+        throw std::runtime_error("Failed to initialize ChaCha20");
+    }
+}
 
 /**
- * @brief Generates the final additive mask for a single client.
+ * Folds words [offset, offset + words) of tower `towerIndex` of every seed's
+ * stream into the same coefficients of `tower`. Tower i of a stream occupies
+ * words [base + i*N, base + (i+1)*N), so each (tower, chunk) can be produced
+ * independently.
+ */
+void AccumulateChunk(EVP_CIPHER_CTX* ctx, const std::vector<MaskSeed>& seeds, uint64_t baseWord,
+                     size_t towerIndex, size_t ringDim, size_t offset, size_t words,
+                     NativePoly& tower, uint64_t* scratch) {
+    const NativeInteger modulus = tower.GetModulus();
+    const uint64_t q = modulus.ConvertToInt();
+    unsigned char* scratch_bytes = reinterpret_cast<unsigned char*>(scratch);
+
+    for (const MaskSeed& seed : seeds) {
+        // "Encrypt" a zero buffer to get this piece of the keystream.
+        SeekKeystream(ctx, seed.key, baseWord + towerIndex * ringDim + offset);
+        int out_len;
+        std::memset(scratch, 0, words * sizeof(uint64_t));
+        EVP_EncryptUpdate(ctx, scratch_bytes, &out_len, scratch_bytes, static_cast<int>(words * sizeof(uint64_t)));
+
+        // Map the words into [0, q) with the vectorized multiply-shift kernel.
+        ReduceKeystream(scratch, scratch, words, q);
+
+        if (seed.subtract) {
+            for (size_t j = 0; j < words; ++j) {
+                tower[offset + j].ModSubFastEq(NativeInteger(scratch[j]), modulus);
+            }
+        } else {
+            for (size_t j = 0; j < words; ++j) {
+                tower[offset + j].ModAddFastEq(NativeInteger(scratch[j]), modulus);
+            }
+        }
+    }
+}
+
+/**
+ * Adds every seed's pseudo-random polynomial into `target`. Work is split into
+ * (tower, chunk) units that own disjoint slices of `target`, so threads write
+ * straight into it without partial accumulators or a final reduction. Modular
+ * addition is exact and order-independent, so the result is bit-identical to
+ * the serial loop for any thread count. `baseWord` is where the keystream for
+ * tower 0 starts; it separates the chunks of a multi-ciphertext tensor.
+ */
+void AccumulateMaskSeeds(const std::vector<MaskSeed>& seeds, DCRTPoly& target, int numThreads,
+                         uint64_t baseWord = 0) {
+    if (target.GetFormat() != Format::EVALUATION) {
+        throw std::runtime_error("Mask target must be in EVALUATION format");
+    }
+    const size_t ring_dim = target.GetRingDimension();
+    const size_t num_towers = target.GetNumOfElements();
+    const size_t chunks_per_tower = (ring_dim + PRG_CHUNK_WORDS - 1) / PRG_CHUNK_WORDS;
+
+    ParallelFor(static_cast<int>(num_towers * chunks_per_tower), ResolveThreadCount(numThreads), [&](int unit) {
+        size_t tower_index = unit / chunks_per_tower;
+        size_t offset = (unit % chunks_per_tower) * PRG_CHUNK_WORDS;
+        size_t words = std::min(PRG_CHUNK_WORDS, ring_dim - offset);
+
+        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+        if (!ctx) throw std::runtime_error("Failed to create EVP_CIPHER_CTX for ChaCha20");
+        uint64_t scratch[PRG_CHUNK_WORDS];
+        try {
+            AccumulateChunk(ctx, seeds, baseWord, tower_index, ring_dim, offset, words,
+                            target.ElementAtIndex(tower_index), scratch);
+        } catch (...) {
+            EVP_CIPHER_CTX_free(ctx);
+            throw;
+        }
+        EVP_CIPHER_CTX_free(ctx);
+    });
+}
+
+} // namespace
+
+/**
+ * @brief Accumulates the additive mask for a single client into `target`.
  *
  * This function iterates through all other clients (peers). For each peer, it
  * computes a shared secret and uses it to generate a random polynomial `p_ij`.
@@ -204,36 +437,169 @@ DCRTPoly PRGToDCRTPoly(const std::vector<unsigned char>& seed, CryptoContext<DCR
  * Since `p_ij` and `p_ji` are generated from the same shared secret, they are
  * identical, and this scheme guarantees `sum(all masks) = 0`.
  *
+ * Both phases run in parallel: the ECDH derivations are split across peers,
+ * and the PRG expansion is split across RNS towers and coefficient chunks.
+ *
  * @param myId The ID of the current client.
  * @param myKeys The ECDH key pair of the current client.
  * @param allPublicKeys A map of all client IDs to their public ECDH keys.
- * @param cc The crypto context.
+ * @param target The polynomial the mask is added to (e.g. the client's share d).
+ * @param numThreads Threads to use; 0 = all available (1 inside a parallel region).
+ */
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const PeerKeyDirectory& peerKeys, const std::vector<uint32_t>& neighbourIds,
+               DCRTPoly& target, int numThreads) {
+    // 1. Peer-parallel: establish a shared secret with every neighbour.
+    std::vector<PairwiseSecret> secrets = ComputePairwiseSecrets(myId, myKeys, peerKeys, neighbourIds, numThreads);
+
+    // 2. Tower/chunk-parallel: fold every p_ij into the target. The sign is
+    // chosen by ID comparison to ensure global cancellation.
+    std::vector<MaskSeed> seeds;
+    seeds.reserve(secrets.size());
+    for (const PairwiseSecret& ps : secrets) {
+        seeds.push_back(MakeMaskSeed(ps.secret, myId < ps.peerId));
+    }
+    AccumulateMaskSeeds(seeds, target, numThreads);
+}
+
+// Masks with every other client in the directory (the complete graph).
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const PeerKeyDirectory& peerKeys,
+               DCRTPoly& target, int numThreads) {
+    ApplyMask(myId, myKeys, peerKeys, AllPeerIds(myId, peerKeys), target, numThreads);
+}
+
+// Convenience overload for callers holding only serialized keys; parses them first.
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const std::map<uint32_t, ECDHPublicKey>& allPublicKeys,
+               DCRTPoly& target, int numThreads) {
+    ApplyMask(myId, myKeys, PeerKeyDirectory(allPublicKeys), target, numThreads);
+}
+
+/**
+ * @brief Computes the ECDH shared secret with each listed neighbour.
+ * Neighbours are split into one contiguous block per thread; each block reuses
+ * a single derivation context against the pre-parsed peer keys.
+ * @return One PairwiseSecret per neighbour, in the order given.
+ */
+std::vector<PairwiseSecret> ComputePairwiseSecrets(uint32_t myId, const SafePKey& myKeys,
+                                                   const PeerKeyDirectory& peerKeys,
+                                                   const std::vector<uint32_t>& neighbourIds,
+                                                   int numThreads) {
+    std::vector<size_t> peers;
+    peers.reserve(neighbourIds.size());
+    for (uint32_t id : neighbourIds) {
+        if (id == myId) throw std::invalid_argument("A client cannot be its own masking neighbour");
+        peers.push_back(peerKeys.indexOf(id));
+    }
+
+    std::vector<PairwiseSecret> secrets(peers.size());
+    if (peers.empty()) return secrets;
+    int threads = std::max(1, std::min(ResolveThreadCount(numThreads), static_cast<int>(peers.size())));
+    size_t block = (peers.size() + threads - 1) / threads;
+    ParallelFor(threads, threads, [&](int t) {
+        size_t begin = t * block;
+        size_t end = std::min(peers.size(), begin + block);
+        if (begin >= end) return;
+        ECDHDeriver deriver(myKeys);
+        for (size_t k = begin; k < end; ++k) {
+            secrets[k].peerId = peerKeys.idAt(peers[k]);
+            secrets[k].secret = deriver.derive(peerKeys.keyAt(peers[k]));
+        }
+    });
+    return secrets;
+}
+
+// Computes the secret with every other client in the directory (the complete graph).
+std::vector<PairwiseSecret> ComputePairwiseSecrets(uint32_t myId, const SafePKey& myKeys,
+                                                   const PeerKeyDirectory& peerKeys,
+                                                   int numThreads) {
+    return ComputePairwiseSecrets(myId, myKeys, peerKeys, AllPeerIds(myId, peerKeys), numThreads);
+}
+
+/**
+ * @brief Derives the mask seed for a given round from a cached pairwise secret.
+ *
+ * HKDF-SHA256 with the shared secret as input keying material and the round
+ * number in the info string. Both peers of a pair derive the same seed, so
+ * masks still cancel, while every round gets an independent keystream.
+ *
+ * @param sharedSecret The ECDH secret established once with the peer.
+ * @param round The training round number.
+ * @return A 32-byte ChaCha20 key for this pair and round.
+ */
+std::vector<unsigned char> DeriveRoundSeed(const std::vector<unsigned char>& sharedSecret, uint32_t round) {
+    static const char label[] = "secure_fl mask round";
+    unsigned char info[sizeof(label) - 1 + 4];
+    std::memcpy(info, label, sizeof(label) - 1);
+    for (int b = 0; b < 4; ++b) {
+        info[sizeof(label) - 1 + b] = static_cast<unsigned char>(round >> (8 * b));
+    }
+
+    EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    if (!pctx) throw std::runtime_error("Failed to create EVP_PKEY_CTX for HKDF");
+
+    std::vector<unsigned char> seed(32);
+    size_t seed_len = seed.size();
+    if (EVP_PKEY_derive_init(pctx) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(pctx, EVP_sha256()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(pctx, sharedSecret.data(), static_cast<int>(sharedSecret.size())) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(pctx, info, sizeof(info)) <= 0 ||
+        EVP_PKEY_derive(pctx, seed.data(), &seed_len) <= 0) {
+        EVP_PKEY_CTX_free(pctx);
+        throw std::runtime_error("Failed to derive round seed");
+    }
+
+    EVP_PKEY_CTX_free(pctx);
+    return seed;
+}
+
+/**
+ * @brief Accumulates a client's mask for one round from its cached pairwise secrets.
+ * Only the KDF and the PRG expansion are paid per round; no ECDH is performed.
+ */
+void ApplyRoundMask(uint32_t myId, const std::vector<PairwiseSecret>& secrets, uint32_t round,
+                    DCRTPoly& target, int numThreads) {
+    std::vector<MaskSeed> seeds(secrets.size());
+    for (size_t k = 0; k < secrets.size(); ++k) {
+        seeds[k] = MakeMaskSeed(DeriveRoundSeed(secrets[k].secret, round), myId < secrets[k].peerId);
+    }
+    AccumulateMaskSeeds(seeds, target, numThreads);
+}
+
+/**
+ * @brief Accumulates a client's mask for one chunk of a multi-ciphertext tensor.
+ *
+ * Every chunk is masked from the same pairwise secrets: chunk c reads each
+ * pair's ChaCha20 stream from word c * L * N onward (L towers of N words), so
+ * chunks never reuse keystream and no per-chunk ECDH or KDF is needed. Chunk 0
+ * is exactly the single-ciphertext mask of ApplyMask().
+ *
+ * @param myId The ID of the current client.
+ * @param secrets The pairwise secrets from ComputePairwiseSecrets().
+ * @param chunkIndex Index of the chunk within the tensor.
+ * @param target The chunk's polynomial; every client must use the same tower count.
+ * @param numThreads Threads to use; 0 = all available (1 inside a parallel region).
+ */
+void ApplyChunkMask(uint32_t myId, const std::vector<PairwiseSecret>& secrets, uint32_t chunkIndex,
+                    DCRTPoly& target, int numThreads) {
+    std::vector<MaskSeed> seeds(secrets.size());
+    for (size_t k = 0; k < secrets.size(); ++k) {
+        seeds[k] = MakeMaskSeed(secrets[k].secret, myId < secrets[k].peerId);
+    }
+    uint64_t chunk_words = static_cast<uint64_t>(target.GetNumOfElements()) * target.GetRingDimension();
+    AccumulateMaskSeeds(seeds, target, numThreads, chunkIndex * chunk_words);
+}
+
+/**
+ * @brief Generates the final additive mask for a single client as a standalone polynomial.
  * @return The final DCRTPoly mask for this client.
  */
 DCRTPoly GenerateMask(uint32_t myId, const SafePKey& myKeys, 
                       const std::map<uint32_t, ECDHPublicKey>& allPublicKeys,
-                      CryptoContext<DCRTPoly>& cc) {
-    
+                      CryptoContext<DCRTPoly>& cc, int numThreads) {
     auto params = cc->GetCryptoParameters()->GetElementParams();
     DCRTPoly final_mask(params, Format::EVALUATION, true); // Initialize mask to zero.
-
-    for (const auto& pair : allPublicKeys) {
-        uint32_t peerId = pair.first;
-        if (myId == peerId) continue; // Skip self.
-
-        // Establish shared secret with the peer.
-        SafePKey peerPubKey = DeserializePublicKey(pair.second);
-        std::vector<unsigned char> sharedSecret = ComputeSharedSecret(myKeys, peerPubKey);
-
-        // Generate a random polynomial from this shared secret.
-        DCRTPoly p_ij = PRGToDCRTPoly(sharedSecret, cc);
-        
-        // Add or subtract based on ID comparison to ensure global cancellation.
-        if (myId < peerId) {
-            final_mask -= p_ij;
-        } else {
-            final_mask += p_ij;
-        }
-    }
+    ApplyMask(myId, myKeys, allPublicKeys, final_mask, numThreads);
     return final_mask;
 }
@@ -7,6 +7,7 @@
 #define MASKING_H
 
 #include "common.h"
+#include "key_directory.h"
 
 // Generates a new ECDH key pair using OpenSSL.
 SafePKey GenerateECDHKeys();
@@ -17,12 +18,102 @@ ECDHPublicKey SerializePublicKey(const SafePKey& keys);
 // Deserializes a byte vector back into an OpenSSL public key object.
 SafePKey DeserializePublicKey(const ECDHPublicKey& pubKeyBytes);
 
+// Exports/imports the raw 32-byte X25519 public key (no DER encoding).
+ECDHPublicKey SerializeRawPublicKey(const SafePKey& keys);
+SafePKey LoadRawPublicKey(const unsigned char* rawKey);
+
 // Computes a shared secret between my private key and a peer's public key.
 std::vector<unsigned char> ComputeSharedSecret(const SafePKey& myKeys, const SafePKey& peerPubKey);
 
+// Every peer's public key, parsed once into a reusable EVP_PKEY. Built once per
+// cohort and then shared read-only by all client threads, so mask generation
+// never re-parses DER keys.
+class PeerKeyDirectory {
+public:
+    explicit PeerKeyDirectory(const std::map<uint32_t, ECDHPublicKey>& allPublicKeys);
+    // Loads keys straight from a raw (e.g. memory-mapped) directory, skipping DER.
+    explicit PeerKeyDirectory(const RawKeyDirectory& rawKeys);
+
+    size_t size() const { return m_ids.size(); }
+    uint32_t idAt(size_t index) const { return m_ids[index]; }
+    EVP_PKEY* keyAt(size_t index) const { return m_keys[index].get(); }
+    // Position of client `id` in the directory; throws if the ID is unknown.
+    size_t indexOf(uint32_t id) const;
+
+private:
+    std::vector<uint32_t> m_ids; // Ascending client IDs.
+    std::vector<SafePKey> m_keys;
+};
+
+// The communication graph that decides which client pairs share a mask.
+// Masks cancel for any graph, because every edge contributes +p_ij to one
+// endpoint and -p_ij to the other. The complete graph is the classic protocol
+// (O(n) peers per client). The k-regular graph (SecAgg+ style) is a Harary
+// graph over a permutation of the clients drawn from a public seed: each client
+// is linked to the k/2 clients on either side of it, so it masks with only k peers.
+class MaskingGraph {
+public:
+    static MaskingGraph Complete(uint32_t numClients);
+    // k is rounded up to an even number; k >= n - 1 yields the complete graph.
+    static MaskingGraph KRegular(uint32_t numClients, uint32_t k, uint64_t publicSeed);
+
+    // Ascending IDs of the clients `id` exchanges masks with (never itself).
+    std::vector<uint32_t> neighbours(uint32_t id) const;
+    uint32_t degree() const { return m_degree; }
+    uint32_t numClients() const { return m_numClients; }
+    bool isComplete() const { return m_permutation.empty(); }
+
+private:
+    uint32_t m_numClients{0};
+    uint32_t m_degree{0};
+    std::vector<uint32_t> m_permutation; // Ring order of clients; empty when complete.
+    std::vector<uint32_t> m_position;    // Inverse of m_permutation.
+};
+
+// Adds this client's full pairwise mask directly into `target`, without temporaries.
+// ECDH is split across peers and the PRG across towers/chunks; numThreads = 0 uses
+// all available cores. The result is bit-identical for every thread count.
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const PeerKeyDirectory& peerKeys,
+               DCRTPoly& target, int numThreads = 0);
+// Same, restricted to the given neighbours (e.g. from MaskingGraph::neighbours).
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const PeerKeyDirectory& peerKeys, const std::vector<uint32_t>& neighbourIds,
+               DCRTPoly& target, int numThreads = 0);
+void ApplyMask(uint32_t myId, const SafePKey& myKeys,
+               const std::map<uint32_t, ECDHPublicKey>& allPublicKeys,
+               DCRTPoly& target, int numThreads = 0);
+
+// --- Multi-Round Masking ---
+// Secrets from ComputePairwiseSecrets() are cached once and reused across rounds.
+
+// Derives the shared secret with every peer (skipping self). Each worker thread
+// reuses one derivation context and only swaps the peer key.
+std::vector<PairwiseSecret> ComputePairwiseSecrets(uint32_t myId, const SafePKey& myKeys,
+                                                   const PeerKeyDirectory& peerKeys,
+                                                   int numThreads = 0);
+std::vector<PairwiseSecret> ComputePairwiseSecrets(uint32_t myId, const SafePKey& myKeys,
+                                                   const PeerKeyDirectory& peerKeys,
+                                                   const std::vector<uint32_t>& neighbourIds,
+                                                   int numThreads = 0);
+
+// Derives the PRG seed for one round from a cached pairwise secret (HKDF-SHA256).
+std::vector<unsigned char> DeriveRoundSeed(const std::vector<unsigned char>& sharedSecret, uint32_t round);
+
+// Adds this client's mask for `round` into `target`, using cached pairwise secrets.
+void ApplyRoundMask(uint32_t myId, const std::vector<PairwiseSecret>& secrets, uint32_t round,
+                    DCRTPoly& target, int numThreads = 0);
+
+// --- Tensor Masking ---
+// Adds this client's mask for chunk `chunkIndex` of a multi-ciphertext tensor into
+// `target`. One secret per peer covers every chunk: chunk c uses the keystream
+// from word c * towers * N onward (counter-mode offset), so chunks never overlap.
+void ApplyChunkMask(uint32_t myId, const std::vector<PairwiseSecret>& secrets, uint32_t chunkIndex,
+                    DCRTPoly& target, int numThreads = 0);
+
 // Generates the final additive mask for a client.
 DCRTPoly GenerateMask(uint32_t myId, const SafePKey& myKeys, 
                       const std::map<uint32_t, ECDHPublicKey>& allPublicKeys,
-                      CryptoContext<DCRTPoly>& cc);
+                      CryptoContext<DCRTPoly>& cc, int numThreads = 0);
 
 #endif // MASKING_H
@@ -4,6 +4,9 @@
 // definitions of all the core cryptographic functions.
 
 #include "mk_ckks.h"
+#include "noise_sampler.h"
+#include <complex>
+#include <mutex>
 
 /**
  * @brief Generates the Common Reference String (CRS), which is the shared polynomial 'a'.
@@ -18,12 +21,11 @@ DCRTPoly GenerateCRS(CryptoContext<DCRTPoly>& cc) {
  * @brief Generates a single key pair for a client using the provided CRS.
  */
 MKeyGenKeyPair KeyGenSingle(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a) {
-    auto params = cc->GetCryptoParameters()->GetElementParams();
     auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(cc->GetCryptoParameters());
-    auto& dgg = cryptoParams->GetDiscreteGaussianGenerator();
+    const double sigma = cryptoParams->GetDistributionParameter();
 
-    DCRTPoly s_i(dgg, params, Format::EVALUATION);
-    DCRTPoly e_i(dgg, params, Format::EVALUATION);
+    DCRTPoly s_i = SampleNoise(cc, sigma);
+    DCRTPoly e_i = SampleNoise(cc, sigma);
     DCRTPoly b_i = s_i.Negate() * crs_a + e_i;
     
     MKeyGenKeyPair kp;
@@ -34,11 +36,45 @@ MKeyGenKeyPair KeyGenSingle(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a)
     return kp;
 }
 
+// Slots a vector of dataSize values occupies under `packing`.
+uint32_t SlotsForData(uint32_t dataSize, SlotPacking packing) {
+    return (packing == SlotPacking::COMPLEX) ? (dataSize + 1) / 2 : dataSize;
+}
+
+double SlotMagnitude(double maxAbs, SlotPacking packing) {
+    return (packing == SlotPacking::COMPLEX) ? std::sqrt(2.0) * maxAbs : maxAbs;
+}
+
+uint32_t ChunkCapacity(CryptoContext<DCRTPoly>& cc, SlotPacking packing) {
+    uint32_t batchSize = cc->GetEncodingParams()->GetBatchSize();
+    if (batchSize == 0) {
+        batchSize = cc->GetCryptoParameters()->GetElementParams()->GetRingDimension() / 2;
+    }
+    return (packing == SlotPacking::COMPLEX) ? 2 * batchSize : batchSize;
+}
+
+uint32_t NumChunks(uint32_t dataSize, uint32_t chunkCapacity) {
+    return std::max<uint32_t>(1, (dataSize + chunkCapacity - 1) / chunkCapacity);
+}
+
 /**
  * @brief Encodes a vector of doubles into a DCRTPoly using the official library encoder.
+ * With COMPLEX packing the first ceil(d/2) entries go into the real parts and
+ * the rest into the imaginary parts of the slots, so the vector needs only half
+ * as many slots (and, once the batch size drops, half the ring dimension).
  */
-DCRTPoly encodeVector(CryptoContext<DCRTPoly>& cc, const std::vector<double>& vec) {
-    Plaintext ptxt = cc->MakeCKKSPackedPlaintext(vec);
+DCRTPoly encodeVector(CryptoContext<DCRTPoly>& cc, const std::vector<double>& vec, SlotPacking packing) {
+    if (packing == SlotPacking::REAL) {
+        Plaintext ptxt = cc->MakeCKKSPackedPlaintext(vec);
+        return ptxt->GetElement<DCRTPoly>();
+    }
+    const size_t half = SlotsForData(static_cast<uint32_t>(vec.size()), packing);
+    std::vector<std::complex<double>> slots(half);
+    for (size_t j = 0; j < half; ++j) {
+        double imag = (j + half < vec.size()) ? vec[j + half] : 0.0;
+        slots[j] = std::complex<double>(vec[j], imag);
+    }
+    Plaintext ptxt = cc->MakeCKKSPackedPlaintext(slots);
     return ptxt->GetElement<DCRTPoly>();
 }
 
@@ -55,50 +91,493 @@ MKCiphertext Encrypt(CryptoContext<DCRTPoly>& cc,
                     const MKeyGenPublicKey& pk, 
                     const MKeyGenSecretKey& sk, // sk is now available
                     const DCRTPoly& m) {
+    return EncryptWithPad(PrecomputeEncryptionPad(cc, pk, sk), m);
+}
+
+/**
+ * @brief Offline half of Encrypt: all sampling and ring products.
+ * None of this depends on the plaintext, so it can run before the data is ready.
+ * @param cc The crypto context.
+ * @param pk The public key of the client.
+ * @param sk The secret key of the client.
+ * @return The pad (c0Pad, c1Pad) for one future encryption.
+ */
+EncryptionPad PrecomputeEncryptionPad(CryptoContext<DCRTPoly>& cc,
+                                      const MKeyGenPublicKey& pk,
+                                      const MKeyGenSecretKey& sk) {
     auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(cc->GetCryptoParameters());
-    auto params = cc->GetCryptoParameters()->GetElementParams();
-    auto& dgg = cryptoParams->GetDiscreteGaussianGenerator();
+    const double sigma = cryptoParams->GetDistributionParameter();
 
-    DCRTPoly v(dgg, params, Format::EVALUATION);
-    DCRTPoly e0(dgg, params, Format::EVALUATION);
-    DCRTPoly e1(dgg, params, Format::EVALUATION);
+    DCRTPoly v = SampleNoise(cc, sigma);
+    DCRTPoly e0 = SampleNoise(cc, sigma);
+    DCRTPoly e1 = SampleNoise(cc, sigma);
 
-    DCRTPoly m_ntt = m;
-    if (m_ntt.GetFormat() == Format::COEFFICIENT) {
-        m_ntt.SwitchFormat();
-    }
+    EncryptionPad pad;
+    // c0 without the message.
+    pad.c0Pad = v * pk.b + e0;
 
-    MKCiphertext ct;
-    // Compute c0 as usual
-    ct.c0 = v * pk.b + m_ntt + e0;
-    
     // Compute the intermediate c1
     DCRTPoly intermediate_c1 = v * pk.a + e1;
 
-    // Define the large decryption noise
-    DiscreteGaussianGeneratorImpl<NativeVector> dgg_large_variance(4.0);
-    DCRTPoly e_star(dgg_large_variance, params, Format::EVALUATION);
+    // Define the large decryption noise (its sampler state is cached per context).
+    DCRTPoly e_star = SampleNoise(cc, E_STAR_SIGMA);
 
     // Compute the final second component, which is the partial decryption share d.
-    // This now works because `sk` is passed into the function.
-    ct.c1 = intermediate_c1 * sk.s + e_star;
+    pad.c1Pad = intermediate_c1 * sk.s + e_star;
 
+    return pad;
+}
+
+/**
+ * @brief Online half of Encrypt: adds the message into a precomputed pad.
+ * The pad may have been reduced to fewer towers (and masked) beforehand; the
+ * message is reduced to match.
+ * @param pad The pad for this encryption; it is consumed.
+ * @param m The plaintext polynomial to encrypt.
+ * @return An MKCiphertext struct where c1 is the partial decryption share 'd'.
+ */
+MKCiphertext EncryptWithPad(EncryptionPad&& pad, const DCRTPoly& m) {
+    MKCiphertext ct;
+    ct.c0 = std::move(pad.c0Pad);
+    ct.c1 = std::move(pad.c1Pad);
+
+    // The encoder already returns NTT form; only copy m if it has to be converted.
+    const DCRTPoly* m_ntt = &m;
+    DCRTPoly converted;
+    if (m.GetFormat() == Format::COEFFICIENT) {
+        converted = m;
+        converted.SwitchFormat();
+        m_ntt = &converted;
+    }
+    // Tower by tower, so the message's extra towers are skipped instead of dropped.
+    const size_t padTowers = ct.c0.GetNumOfElements();
+    for (size_t i = 0; i < padTowers; ++i) {
+        ct.c0.ElementAtIndex(i) += m_ntt->GetElementAtIndex(i);
+    }
     return ct;
 }
 
+// =================================================================================
+// PREPARED-KEY ENCRYPTION
+// =================================================================================
+// The generic path above multiplies whole DCRTPolys: every product checks
+// formats, allocates a temporary and reduces with a full 128-bit modulo, and
+// v*b, v*a + e1, (v*a + e1)*s and e* each make a full pass over all towers.
+// The keys never change between rounds, so each client converts them once
+// into raw NTT words with Shoup quotients. Encryption is then tower-major:
+// the noise is sampled once as small signed integers, and for each kept tower
+// it is lifted and transformed, and one fused pass writes
+//   c0 = v*b + m + e0   and   d = (v*a + e1)*s + e*.
+// Only c0 and d are allocated at full size; e0 and e1 are lifted straight into
+// them, and v and e* only ever occupy one tower of scratch space.
+
+namespace {
+
+inline uint64_t ShoupQuotient(uint64_t w, uint64_t q) {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(w) << 64) / q);
+}
+
+// x * w mod q for a fixed w < q < 2^63 with precomputed wShoup.
+inline uint64_t MulShoup(uint64_t x, uint64_t w, uint64_t wShoup, uint64_t q) {
+    uint64_t hi = static_cast<uint64_t>((static_cast<unsigned __int128>(x) * wShoup) >> 64);
+    uint64_t r = x * w - hi * q;
+    return (r >= q) ? r - q : r;
+}
+
+inline uint64_t AddMod(uint64_t a, uint64_t b, uint64_t q) {
+    uint64_t r = a + b;
+    return (r >= q) ? r - q : r;
+}
+
+void PrepareOperand(const NativePoly& tower, uint64_t q, size_t ringDim,
+                    std::vector<uint64_t>& values, std::vector<uint64_t>& shoup) {
+    values.resize(ringDim);
+    shoup.resize(ringDim);
+    for (size_t j = 0; j < ringDim; ++j) {
+        values[j] = tower[j].ConvertToInt();
+        shoup[j] = ShoupQuotient(values[j], q);
+    }
+}
+
+// The four noise polynomials of one encryption, as signed coefficients.
+struct EncryptionNoise {
+    std::vector<int64_t> v, e0, e1, eStar;
+};
+
+// Lifts signed coefficients into one tower (x mod q) and moves it to NTT form.
+NativePoly LiftToTower(const std::vector<int64_t>& samples, const std::shared_ptr<ILNativeParams>& params,
+                       uint64_t q) {
+    NativePoly tower(params, Format::COEFFICIENT, true);
+    for (size_t j = 0; j < samples.size(); ++j) {
+        int64_t x = samples[j];
+        tower[j] = NativeInteger(x < 0 ? q - static_cast<uint64_t>(-x) : static_cast<uint64_t>(x));
+    }
+    tower.SwitchFormat();
+    return tower;
+}
+
+// The fused kernel for one tower. On entry c0 and c1 hold e0 and e1 (NTT form);
+// on exit they hold v*b + m + e0 and (v*a + e1)*s + e*. `m` may be null (pad only).
+void EncryptTower(const PreparedKeyTower& key, const NativePoly& v, const NativePoly& eStar,
+                  const NativePoly* m, NativePoly& c0, NativePoly& c1) {
+    const uint64_t q = key.modulus;
+    const size_t ringDim = key.b.size();
+    for (size_t j = 0; j < ringDim; ++j) {
+        const uint64_t vj = v[j].ConvertToInt();
+        uint64_t out0 = AddMod(MulShoup(vj, key.b[j], key.bShoup[j], q), c0[j].ConvertToInt(), q);
+        if (m) out0 = AddMod(out0, (*m)[j].ConvertToInt(), q);
+        const uint64_t t = AddMod(MulShoup(vj, key.a[j], key.aShoup[j], q), c1[j].ConvertToInt(), q);
+        c0[j] = NativeInteger(out0);
+        c1[j] = NativeInteger(AddMod(MulShoup(t, key.s[j], key.sShoup[j], q), eStar[j].ConvertToInt(), q));
+    }
+}
+
+// Shared body of the prepared Encrypt and PrecomputeEncryptionPad.
+MKCiphertext EncryptFused(const EncryptionContext& ectx, const DCRTPoly* m, uint32_t numTowers) {
+    CryptoContext<DCRTPoly> cc = ectx.cc;
+    const size_t totalTowers = ectx.towers.size();
+    const size_t towers = (numTowers == 0 || numTowers > totalTowers) ? totalTowers : numTowers;
+
+    EncryptionNoise noise;
+    SampleNoiseCoefficients(cc, ectx.sigma, noise.v);
+    SampleNoiseCoefficients(cc, ectx.sigma, noise.e0);
+    SampleNoiseCoefficients(cc, ectx.sigma, noise.e1);
+    SampleNoiseCoefficients(cc, E_STAR_SIGMA, noise.eStar);
+
+    const DCRTPoly* m_ntt = m;
+    DCRTPoly converted;
+    if (m && m->GetFormat() == Format::COEFFICIENT) {
+        converted = *m;
+        converted.SwitchFormat();
+        m_ntt = &converted;
+    }
+
+    // Tower storage is left unallocated here and filled by the lifts below.
+    MKCiphertext ct;
+    ct.c0 = DCRTPoly(ectx.params, Format::EVALUATION, false);
+    ct.c1 = DCRTPoly(ectx.params, Format::EVALUATION, false);
+    if (towers < totalTowers) {
+        ct.c0.DropLastElements(totalTowers - towers);
+        ct.c1.DropLastElements(totalTowers - towers);
+    }
+
+    const auto& towerParams = ectx.params->GetParams();
+    for (size_t i = 0; i < towers; ++i) {
+        const uint64_t q = ectx.towers[i].modulus;
+        NativePoly v = LiftToTower(noise.v, towerParams[i], q);
+        NativePoly eStar = LiftToTower(noise.eStar, towerParams[i], q);
+        ct.c0.SetElementAtIndex(i, LiftToTower(noise.e0, towerParams[i], q));
+        ct.c1.SetElementAtIndex(i, LiftToTower(noise.e1, towerParams[i], q));
+        EncryptTower(ectx.towers[i], v, eStar, m_ntt ? &m_ntt->GetElementAtIndex(i) : nullptr,
+                     ct.c0.ElementAtIndex(i), ct.c1.ElementAtIndex(i));
+    }
+    return ct;
+}
+
+} // namespace
+
+/**
+ * @brief Converts a client's key pair into the prepared form used by every later encryption.
+ * @param cc The crypto context.
+ * @param keys The client's key pair (all polynomials in EVALUATION format).
+ * @return The prepared keys, one PreparedKeyTower per RNS tower.
+ */
+EncryptionContext PrepareEncryptionContext(CryptoContext<DCRTPoly>& cc, const MKeyGenKeyPair& keys) {
+    auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(cc->GetCryptoParameters());
+    const size_t ringDim = cryptoParams->GetElementParams()->GetRingDimension();
+
+    EncryptionContext ectx;
+    ectx.cc = cc;
+    ectx.params = cryptoParams->GetElementParams();
+    ectx.sigma = cryptoParams->GetDistributionParameter();
+    ectx.towers.resize(keys.pk.b.GetNumOfElements());
+    for (size_t i = 0; i < ectx.towers.size(); ++i) {
+        PreparedKeyTower& tower = ectx.towers[i];
+        tower.modulus = keys.pk.b.GetElementAtIndex(i).GetModulus().ConvertToInt();
+        PrepareOperand(keys.pk.b.GetElementAtIndex(i), tower.modulus, ringDim, tower.b, tower.bShoup);
+        PrepareOperand(keys.pk.a.GetElementAtIndex(i), tower.modulus, ringDim, tower.a, tower.aShoup);
+        PrepareOperand(keys.sk.s.GetElementAtIndex(i), tower.modulus, ringDim, tower.s, tower.sShoup);
+    }
+    return ectx;
+}
+
 /**
- * @brief Decodes a raw DCRTPoly back into a vector of doubles using the OpenFHE API.
+ * @brief Offline half of Encrypt over prepared keys (the fused kernel without m).
+ * @param ectx The client's prepared keys.
+ * @param numTowers Number of leading towers to compute (0 = all).
+ * @return The pad for one future encryption, at numTowers towers.
  */
-std::vector<double> Decode(const DCRTPoly& finalPoly, CryptoContext<DCRTPoly>& cc, uint32_t dataSize) {
-    KeyPair<DCRTPoly> tempKeys = cc->KeyGen();
-    std::vector<double> dummy_vec = {0.0};
-    Plaintext ptxt_template = cc->MakeCKKSPackedPlaintext(dummy_vec);
-    Ciphertext<DCRTPoly> dummyCiphertext = cc->Encrypt(tempKeys.publicKey, ptxt_template);
+EncryptionPad PrecomputeEncryptionPad(const EncryptionContext& ectx, uint32_t numTowers) {
+    MKCiphertext ct = EncryptFused(ectx, nullptr, numTowers);
+    EncryptionPad pad;
+    pad.c0Pad = std::move(ct.c0);
+    pad.c1Pad = std::move(ct.c1);
+    return pad;
+}
+
+/**
+ * @brief Encrypt over prepared keys in one fused pass per tower.
+ * Only the towers that are uploaded are sampled, transformed and computed.
+ * @param ectx The client's prepared keys.
+ * @param m The plaintext polynomial to encrypt.
+ * @param numTowers Number of leading towers to keep (0 = all).
+ * @return An MKCiphertext struct where c1 is the partial decryption share 'd'.
+ */
+MKCiphertext Encrypt(const EncryptionContext& ectx, const DCRTPoly& m, uint32_t numTowers) {
+    return EncryptFused(ectx, &m, numTowers);
+}
+
+// =================================================================================
+// DIRECT DECODE ENGINE
+// =================================================================================
+// Decoding used to go through cc->Decrypt, which needs a throwaway KeyGen and a
+// dummy Encrypt on every call. The aggregated polynomial already *is* the
+// decryption (c0 + d with c1 = 0), so we go straight from it to slot values:
+// INTT -> CRT (Garner) reconstruction -> scale by 1/Delta -> inverse canonical
+// embedding (the "special FFT" of CKKS). All tables are built once per context.
+
+namespace {
+
+// Per-context precomputation for the direct decoder.
+struct DecodeTables {
+    uint32_t ringDim{0};
+    uint32_t slots{0};
+    double invScale{0.0};                     // 1 / Delta
+    std::vector<uint64_t> moduli;             // q_0 .. q_{L-1}
+    std::vector<std::vector<uint64_t>> garnerInv; // garnerInv[i][j] = q_j^{-1} mod q_i (j < i)
+    std::vector<uint32_t> bitReverse;         // Bit-reversal permutation of [0, slots)
+    std::vector<uint32_t> rotGroup;           // 5^j mod M
+    std::vector<std::complex<double>> ksiPows; // exp(2*pi*i*k / M), k = 0..M
+};
+
+inline uint64_t MulMod(uint64_t a, uint64_t b, uint64_t q) {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) % q);
+}
+
+uint64_t InvMod(uint64_t a, uint64_t q) {
+    // Extended Euclid; q is prime and a != 0 mod q.
+    __int128 t = 0, newT = 1;
+    __int128 r = q, newR = a % q;
+    while (newR != 0) {
+        __int128 quotient = r / newR;
+        __int128 tmp = t - quotient * newT; t = newT; newT = tmp;
+        tmp = r - quotient * newR; r = newR; newR = tmp;
+    }
+    if (t < 0) t += q;
+    return static_cast<uint64_t>(t);
+}
+
+std::shared_ptr<const DecodeTables> BuildDecodeTables(CryptoContext<DCRTPoly>& cc) {
+    auto tables = std::make_shared<DecodeTables>();
     auto params = cc->GetCryptoParameters()->GetElementParams();
-    DCRTPoly c1_zero(params, Format::EVALUATION, true);
-    dummyCiphertext->SetElements({finalPoly, c1_zero});
-    Plaintext resultPlaintext;
-    cc->Decrypt(tempKeys.secretKey, dummyCiphertext, &resultPlaintext);
-    resultPlaintext->SetLength(dataSize);
-    return resultPlaintext->GetRealPackedValue();
+    tables->ringDim = params->GetRingDimension();
+
+    uint32_t batchSize = cc->GetEncodingParams()->GetBatchSize();
+    tables->slots = (batchSize == 0) ? tables->ringDim / 2 : batchSize;
+
+    // The scaling factor depends on the scaling technique, so read it off a
+    // freshly encoded plaintext rather than re-deriving it here.
+    Plaintext probe = cc->MakeCKKSPackedPlaintext(std::vector<double>{0.0});
+    tables->invScale = 1.0 / probe->GetScalingFactor();
+
+    const auto& towers = params->GetParams();
+    tables->moduli.resize(towers.size());
+    for (size_t i = 0; i < towers.size(); ++i) {
+        tables->moduli[i] = towers[i]->GetModulus().ConvertToInt();
+    }
+    tables->garnerInv.resize(towers.size());
+    for (size_t i = 0; i < towers.size(); ++i) {
+        const uint64_t qi = tables->moduli[i];
+        for (size_t j = 0; j < i; ++j) {
+            tables->garnerInv[i].push_back(InvMod(tables->moduli[j] % qi, qi));
+        }
+    }
+
+    const uint32_t slots = tables->slots;
+    const uint32_t M = 2 * tables->ringDim;
+    uint32_t logSlots = 0;
+    while ((1u << logSlots) < slots) ++logSlots;
+    tables->bitReverse.resize(slots);
+    for (uint32_t i = 0; i < slots; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < logSlots; ++b) {
+            r |= ((i >> b) & 1u) << (logSlots - 1 - b);
+        }
+        tables->bitReverse[i] = r;
+    }
+
+    tables->rotGroup.resize(slots);
+    uint64_t fivePows = 1;
+    for (uint32_t i = 0; i < slots; ++i) {
+        tables->rotGroup[i] = static_cast<uint32_t>(fivePows);
+        fivePows = (fivePows * 5) % M;
+    }
+
+    tables->ksiPows.resize(M + 1);
+    for (uint32_t k = 0; k < M; ++k) {
+        double angle = 2.0 * M_PI * k / M;
+        tables->ksiPows[k] = std::complex<double>(std::cos(angle), std::sin(angle));
+    }
+    tables->ksiPows[M] = tables->ksiPows[0];
+
+    return tables;
+}
+
+// Returns the cached tables for `cc`, building them on first use.
+std::shared_ptr<const DecodeTables> GetDecodeTables(CryptoContext<DCRTPoly>& cc) {
+    static std::mutex cacheMutex;
+    // Keyed by owner, so a new context at a freed context's address is a miss.
+    static std::map<std::weak_ptr<CryptoContextImpl<DCRTPoly>>, std::shared_ptr<const DecodeTables>,
+                    std::owner_less<std::weak_ptr<CryptoContextImpl<DCRTPoly>>>> cache;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = cache.find(cc);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    // Free the tables of contexts that have since been destroyed.
+    for (auto entry = cache.begin(); entry != cache.end();) {
+        entry = entry->first.expired() ? cache.erase(entry) : std::next(entry);
+    }
+    auto tables = BuildDecodeTables(cc);
+    cache.emplace(cc, tables);
+    return tables;
+}
+
+// Garner mixed-radix reconstruction of coefficient `idx` into a centered value.
+// `residues` holds one pointer per tower; `digits` is caller-owned scratch space.
+long double CRTToCentered(const std::vector<const NativeVector*>& residues, size_t idx,
+                          const DecodeTables& t, std::vector<uint64_t>& digits) {
+    const size_t k = residues.size();
+
+    auto garner = [&](bool negate) {
+        for (size_t i = 0; i < k; ++i) {
+            const uint64_t qi = t.moduli[i];
+            uint64_t x = (*residues[i])[idx].ConvertToInt();
+            if (negate && x != 0) x = qi - x;
+            for (size_t j = 0; j < i; ++j) {
+                uint64_t dj = digits[j] % qi;
+                x = (x >= dj) ? x - dj : x + qi - dj;
+                x = MulMod(x, t.garnerInv[i][j], qi);
+            }
+            digits[i] = x;
+        }
+    };
+
+    // A value above Q/2 represents a negative number. For the small values we
+    // decode, that shows up in the top mixed-radix digit; reconstruct -x then.
+    garner(false);
+    bool negative = digits[k - 1] > (t.moduli[k - 1] >> 1);
+    if (negative) garner(true);
+
+    long double value = digits[k - 1];
+    for (size_t i = k - 1; i-- > 0;) {
+        value = value * t.moduli[i] + digits[i];
+    }
+    return negative ? -value : value;
+}
+
+// In-place inverse canonical embedding (HEAAN's fftSpecial).
+void FFTSpecial(std::vector<std::complex<double>>& vals, const DecodeTables& t) {
+    const uint32_t slots = static_cast<uint32_t>(vals.size());
+    const uint32_t M = 2 * t.ringDim;
+    for (uint32_t i = 0; i < slots; ++i) {
+        uint32_t j = t.bitReverse[i];
+        if (i < j) std::swap(vals[i], vals[j]);
+    }
+    for (uint32_t len = 2; len <= slots; len <<= 1) {
+        uint32_t lenh = len >> 1;
+        uint32_t lenq = len << 2;
+        for (uint32_t i = 0; i < slots; i += len) {
+            for (uint32_t j = 0; j < lenh; ++j) {
+                uint32_t idx = (t.rotGroup[j] % lenq) * (M / lenq);
+                std::complex<double> u = vals[i + j];
+                std::complex<double> v = vals[i + j + lenh] * t.ksiPows[idx];
+                vals[i + j] = u + v;
+                vals[i + j + lenh] = u - v;
+            }
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Picks the smallest tower prefix that can carry the aggregate.
+ * The decoded sum is Delta * Sum(m_i) + Sum(e_i), where each client's noise is
+ * v*e + e0 + e1*s + e* (s Gaussian, like e). Coefficients are bounded with a
+ * 6-sigma tail and worst-case ring products, and the prefix must exceed twice the total
+ * bound (centered representation) with one bit of slack.
+ */
+uint32_t MinimalTowerCount(CryptoContext<DCRTPoly>& cc, uint32_t numClients, double maxAbs) {
+    auto tables = GetDecodeTables(cc);
+    auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(cc->GetCryptoParameters());
+
+    const double n = tables->ringDim;
+    const double tail = 6.0 * cryptoParams->GetDistributionParameter();
+    const double tailStar = 6.0 * E_STAR_SIGMA;
+    const double noisePerClient = 2.0 * n * tail * tail + tail + tailStar;
+    const double bound = numClients * (maxAbs / tables->invScale + noisePerClient);
+    const double log2Needed = std::log2(bound) + 2.0;
+
+    double log2Q = 0.0;
+    for (size_t i = 0; i < tables->moduli.size(); ++i) {
+        log2Q += std::log2(static_cast<double>(tables->moduli[i]));
+        if (log2Q >= log2Needed) {
+            return static_cast<uint32_t>(i + 1);
+        }
+    }
+    return static_cast<uint32_t>(tables->moduli.size());
+}
+
+/**
+ * @brief MODIFIED: Decodes a raw DCRTPoly straight into a vector of doubles.
+ * No keys or ciphertexts are built; works for any prefix of the context's towers.
+ */
+std::vector<double> Decode(const DCRTPoly& finalPoly, CryptoContext<DCRTPoly>& cc, uint32_t dataSize,
+                           SlotPacking packing) {
+    auto tables = GetDecodeTables(cc);
+
+    // 1. INTT: bring every tower back to coefficient form.
+    DCRTPoly poly = finalPoly;
+    if (poly.GetFormat() == Format::EVALUATION) {
+        poly.SwitchFormat();
+    }
+
+    const size_t numTowers = poly.GetNumOfElements();
+    std::vector<const NativeVector*> residues(numTowers);
+    for (size_t i = 0; i < numTowers; ++i) {
+        residues[i] = &poly.GetElementAtIndex(i).GetValues();
+    }
+
+    // 2 & 3. CRT-reconstruct only the coefficients that carry slots, and scale.
+    const uint32_t slots = tables->slots;
+    const uint32_t Nh = tables->ringDim / 2;
+    const uint32_t gap = Nh / slots;
+    std::vector<std::complex<double>> values(slots);
+    std::vector<uint64_t> digits(numTowers);
+    for (uint32_t i = 0, idx = 0; i < slots; ++i, idx += gap) {
+        double re = static_cast<double>(CRTToCentered(residues, idx, *tables, digits)) * tables->invScale;
+        double im = static_cast<double>(CRTToCentered(residues, idx + Nh, *tables, digits)) * tables->invScale;
+        values[i] = std::complex<double>(re, im);
+    }
+
+    // 4. Inverse canonical embedding.
+    FFTSpecial(values, *tables);
+
+    if (packing == SlotPacking::COMPLEX) {
+        // Undo encodeVector's layout: real parts first, then imaginary parts.
+        const uint32_t half = std::min(SlotsForData(dataSize, packing), slots);
+        std::vector<double> result(std::min(dataSize, 2 * half));
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = (i < half) ? values[i].real() : values[i - half].imag();
+        }
+        return result;
+    }
+
+    std::vector<double> result(std::min<uint32_t>(dataSize, slots));
+    for (size_t i = 0; i < result.size(); ++i) {
+        result[i] = values[i].real();
+    }
+    return result;
 }
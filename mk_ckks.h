@@ -14,7 +14,22 @@ DCRTPoly GenerateCRS(CryptoContext<DCRTPoly>& cc);
 
 MKeyGenKeyPair KeyGenSingle(CryptoContext<DCRTPoly>& cc, const DCRTPoly& crs_a);
 
-DCRTPoly encodeVector(CryptoContext<DCRTPoly>& cc, const std::vector<double>& vec);
+// Largest batch size used for one ciphertext (ring dimension 2^17). Longer
+// vectors are split into several ciphertexts (see ChunkCapacity).
+const uint32_t MAX_BATCH_SIZE = 1u << 16;
+
+// Number of CKKS slots needed to hold a real vector of length dataSize.
+uint32_t SlotsForData(uint32_t dataSize, SlotPacking packing = SlotPacking::REAL);
+// Largest slot magnitude when every vector entry lies in [-maxAbs, maxAbs].
+double SlotMagnitude(double maxAbs, SlotPacking packing = SlotPacking::REAL);
+
+// Number of vector entries one ciphertext of `cc` carries (batch size, doubled
+// for COMPLEX packing), and the number of such chunks a vector of dataSize needs.
+uint32_t ChunkCapacity(CryptoContext<DCRTPoly>& cc, SlotPacking packing = SlotPacking::REAL);
+uint32_t NumChunks(uint32_t dataSize, uint32_t chunkCapacity);
+
+DCRTPoly encodeVector(CryptoContext<DCRTPoly>& cc, const std::vector<double>& vec,
+                      SlotPacking packing = SlotPacking::REAL);
 
 // MODIFIED: The function signature now correctly accepts the secret key (sk)
 // which is necessary to perform the integrated partial decryption step.
@@ -23,9 +38,61 @@ MKCiphertext Encrypt(CryptoContext<DCRTPoly>& cc,
                     const MKeyGenSecretKey& sk, // Added secret key parameter
                     const DCRTPoly& m);
 
+// Standard deviation of the extra decryption noise e* added to every share d.
+const double E_STAR_SIGMA = 4.0;
+
+// --- Offline/Online Encryption ---
+// Samples v, e0, e1, e* and computes every product with pk and sk (offline phase).
+EncryptionPad PrecomputeEncryptionPad(CryptoContext<DCRTPoly>& cc,
+                                      const MKeyGenPublicKey& pk,
+                                      const MKeyGenSecretKey& sk);
+// Online phase: two additions at most. Consumes the pad (moves its polynomials out).
+MKCiphertext EncryptWithPad(EncryptionPad&& pad, const DCRTPoly& m);
+
+// --- Prepared Keys ---
+// One RNS tower of a client's keys in NTT form, each value next to its Shoup
+// quotient floor(w * 2^64 / q), so a product with the key costs two word
+// multiplies and one conditional subtraction.
+struct PreparedKeyTower {
+    uint64_t modulus{0};
+    std::vector<uint64_t> b, bShoup;
+    std::vector<uint64_t> a, aShoup;
+    std::vector<uint64_t> s, sShoup;
+};
+
+// A client's key pair prepared once (in Client::generateKeys) for every later
+// encryption. Also caches the context and the noise width, so encrypting does
+// no parameter lookups.
+struct EncryptionContext {
+    CryptoContext<DCRTPoly> cc;
+    std::shared_ptr<DCRTPoly::Params> params;
+    double sigma{0.0};
+    std::vector<PreparedKeyTower> towers;
+};
+
+EncryptionContext PrepareEncryptionContext(CryptoContext<DCRTPoly>& cc, const MKeyGenKeyPair& keys);
+
+// Same pad as above, computed in one fused pass per tower over the prepared
+// keys, at the first numTowers towers only (0 = all). Only additions follow
+// encryption, so a share at a prefix of the towers is exact, and the dropped
+// towers are never sampled or computed.
+EncryptionPad PrecomputeEncryptionPad(const EncryptionContext& ectx, uint32_t numTowers = 0);
+// Encrypt over the prepared keys, directly at numTowers towers (0 = all). The
+// message is added inside the same pass, so only c0 and d are allocated.
+MKCiphertext Encrypt(const EncryptionContext& ectx, const DCRTPoly& m, uint32_t numTowers = 0);
+
 // This function is now obsolete and has been fully commented out.
 // DCRTPoly ComputePartialDecryption(CryptoContext<DCRTPoly>& cc, const MKeyGenSecretKey& sk, const MKCiphertext& ct);
 
-std::vector<double> Decode(const DCRTPoly& finalPoly, CryptoContext<DCRTPoly>& cc, uint32_t dataSize);
+// Smallest number of leading RNS towers whose modulus still holds the sum of
+// numClients shares with slot values in [-maxAbs, maxAbs], plus encryption noise.
+// Returns the full tower count if no smaller prefix is large enough.
+uint32_t MinimalTowerCount(CryptoContext<DCRTPoly>& cc, uint32_t numClients, double maxAbs);
+
+// Decodes the aggregated polynomial directly (INTT, CRT, scaling, inverse embedding)
+// using tables cached per context; no temporary keys or ciphertexts are created.
+// With COMPLEX packing the real and imaginary parts are unpacked back into one vector.
+std::vector<double> Decode(const DCRTPoly& finalPoly, CryptoContext<DCRTPoly>& cc, uint32_t dataSize,
+                           SlotPacking packing = SlotPacking::REAL);
 
 #endif // MK_CKKS_H
@@ -0,0 +1,332 @@
+// noise_sampler.cpp
+//
+// Implementation of the noise samplers. OpenFHE's discrete Gaussian generator
+// samples and reduces every coefficient separately for each tower. The
+// centered binomial sampler instead turns one 64-bit ChaCha20 word into one
+// small signed integer with two popcounts, and lifts that integer into every
+// tower in the same pass, so the PRG and the sampling are paid once per
+// coefficient rather than once per (coefficient, tower).
+
+#include "noise_sampler.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SECURE_FL_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+std::atomic<NoiseSamplerKind> g_noiseSampler{NoiseSamplerKind::GAUSSIAN};
+// Set by UsePrgGaussianSampler: draw the discrete Gaussian from NoisePrg, not OpenFHE's PRNG.
+std::atomic<bool> g_prgGaussian{false};
+
+// Random words expanded per ChaCha20 call (32 KB, stays in L1/L2 while lifted).
+constexpr size_t SAMPLE_CHUNK_WORDS = 4096;
+constexpr uint32_t MAX_BINOMIAL_ETA = 32;
+
+using GaussianGenerator = DiscreteGaussianGeneratorImpl<NativeVector>;
+
+// Per-context sampler state: the tower moduli and one Gaussian generator per sigma.
+struct SamplerState {
+    std::shared_ptr<DCRTPoly::Params> params;
+    std::vector<uint64_t> moduli;
+    std::map<double, std::shared_ptr<GaussianGenerator>> gaussians;
+};
+
+std::mutex g_cacheMutex;
+
+// Returns the cached state for `cc`, building it on first use. Caller holds g_cacheMutex.
+SamplerState& GetSamplerState(CryptoContext<DCRTPoly>& cc) {
+    // Keyed by owner, so a new context at a freed context's address is a miss.
+    static std::map<std::weak_ptr<CryptoContextImpl<DCRTPoly>>, SamplerState,
+                    std::owner_less<std::weak_ptr<CryptoContextImpl<DCRTPoly>>>> cache;
+    auto it = cache.find(cc);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    // Drop the state of contexts that have since been destroyed.
+    for (auto entry = cache.begin(); entry != cache.end();) {
+        entry = entry->first.expired() ? cache.erase(entry) : std::next(entry);
+    }
+    SamplerState state;
+    state.params = cc->GetCryptoParameters()->GetElementParams();
+    for (const auto& tower : state.params->GetParams()) {
+        state.moduli.push_back(tower->GetModulus().ConvertToInt());
+    }
+    return cache.emplace(cc, std::move(state)).first->second;
+}
+
+uint32_t BinomialEta(double sigma) {
+    return static_cast<uint32_t>(std::lround(2.0 * sigma * sigma));
+}
+
+
+// A ChaCha20 stream under a fresh 256-bit key, used for one noise polynomial.
+class NoisePrg {
+public:
+    NoisePrg() {
+        unsigned char key[32];
+        unsigned char iv[16] = {0};
+        if (RAND_bytes(key, sizeof(key)) != 1) {
+            throw std::runtime_error("Failed to seed the noise PRG");
+        }
+        m_ctx = EVP_CIPHER_CTX_new();
+        if (!m_ctx || EVP_EncryptInit_ex(m_ctx, EVP_chacha20(), NULL, key, iv) <= 0) {
+            EVP_CIPHER_CTX_free(m_ctx);
+            throw std::runtime_error("Failed to initialize the noise PRG");
+        }
+    }
+    ~NoisePrg() { EVP_CIPHER_CTX_free(m_ctx); }
+    NoisePrg(const NoisePrg&) = delete;
+    NoisePrg& operator=(const NoisePrg&) = delete;
+
+    // Fills words[0..n) with the next n * 8 keystream bytes.
+    void Next(uint64_t* words, size_t n) {
+        unsigned char* bytes = reinterpret_cast<unsigned char*>(words);
+        int out_len;
+        std::memset(words, 0, n * sizeof(uint64_t));
+        EVP_EncryptUpdate(m_ctx, bytes, &out_len, bytes, static_cast<int>(n * sizeof(uint64_t)));
+    }
+
+private:
+    EVP_CIPHER_CTX* m_ctx{nullptr};
+};
+
+// Discrete Gaussian D_{Z,sigma} samples (rho(x) = exp(-x^2 / 2 sigma^2), cut
+// at 12 sigma) by inverting a 64-bit CDF table, as OpenFHE's generator does
+// for small sigma, but driven by one fresh ChaCha20 stream.
+void SamplePrgGaussian(NoisePrg& prg, double sigma, int64_t* out, size_t n) {
+    const int64_t tail = static_cast<int64_t>(std::ceil(12.0 * sigma));
+    std::vector<long double> weights(2 * tail + 1);
+    long double total = 0.0L;
+    for (int64_t x = -tail; x <= tail; ++x) {
+        weights[x + tail] = std::exp(-static_cast<long double>(x * x) / (2.0L * sigma * sigma));
+        total += weights[x + tail];
+    }
+    // cdf[k] = 2^64 * P(X <= k - tail); a word u maps to the first k with u < cdf[k].
+    std::vector<uint64_t> cdf(weights.size());
+    long double running = 0.0L;
+    for (size_t k = 0; k < weights.size(); ++k) {
+        running += weights[k];
+        const long double scaled = running / total * 0x1.0p64L;
+        cdf[k] = scaled >= 0x1.0p64L ? UINT64_MAX : static_cast<uint64_t>(scaled);
+    }
+    cdf.back() = UINT64_MAX;
+
+    uint64_t words[SAMPLE_CHUNK_WORDS];
+    for (size_t offset = 0; offset < n; offset += SAMPLE_CHUNK_WORDS) {
+        const size_t count = std::min(SAMPLE_CHUNK_WORDS, n - offset);
+        prg.Next(words, count);
+        for (size_t j = 0; j < count; ++j) {
+            const size_t k = std::upper_bound(cdf.begin(), cdf.end() - 1, words[j]) - cdf.begin();
+            out[offset + j] = static_cast<int64_t>(k) - tail;
+        }
+    }
+}
+
+// Samples one polynomial's coefficients with `sample(prg, out, n)` and lifts
+// them into every tower of `cc` in the same pass.
+template <typename SampleFn>
+DCRTPoly SampleLifted(CryptoContext<DCRTPoly>& cc, SampleFn sample) {
+    std::shared_ptr<DCRTPoly::Params> params;
+    std::vector<uint64_t> moduli;
+    {
+        std::lock_guard<std::mutex> lock(g_cacheMutex);
+        SamplerState& state = GetSamplerState(cc);
+        params = state.params;
+        moduli = state.moduli;
+    }
+
+    NoisePrg prg;
+    const size_t ringDim = params->GetRingDimension();
+    DCRTPoly poly(params, Format::COEFFICIENT, true);
+    int64_t samples[SAMPLE_CHUNK_WORDS];
+
+    for (size_t offset = 0; offset < ringDim; offset += SAMPLE_CHUNK_WORDS) {
+        const size_t n = std::min(SAMPLE_CHUNK_WORDS, ringDim - offset);
+        sample(prg, samples, n);
+
+        // Lift each signed sample into every tower: x mod q_i.
+        for (size_t i = 0; i < moduli.size(); ++i) {
+            NativePoly& tower = poly.ElementAtIndex(i);
+            const uint64_t q = moduli[i];
+            for (size_t j = 0; j < n; ++j) {
+                int64_t x = samples[j];
+                tower[offset + j] = NativeInteger(x < 0 ? q - static_cast<uint64_t>(-x) : static_cast<uint64_t>(x));
+            }
+        }
+    }
+
+    poly.SwitchFormat();
+    return poly;
+}
+
+DCRTPoly SampleBinomial(CryptoContext<DCRTPoly>& cc, uint32_t eta) {
+    return SampleLifted(cc, [eta](NoisePrg& prg, int64_t* out, size_t n) {
+        uint64_t words[SAMPLE_CHUNK_WORDS];
+        prg.Next(words, n);
+        SampleCenteredBinomial(words, out, n, eta);
+    });
+}
+
+DCRTPoly SampleGaussian(CryptoContext<DCRTPoly>& cc, double sigma) {
+    if (g_prgGaussian.load()) {
+        return SampleLifted(cc, [sigma](NoisePrg& prg, int64_t* out, size_t n) {
+            SamplePrgGaussian(prg, sigma, out, n);
+        });
+    }
+    std::shared_ptr<GaussianGenerator> dgg;
+    std::shared_ptr<DCRTPoly::Params> params;
+    {
+        std::lock_guard<std::mutex> lock(g_cacheMutex);
+        SamplerState& state = GetSamplerState(cc);
+        auto& slot = state.gaussians[sigma];
+        if (!slot) slot = std::make_shared<GaussianGenerator>(sigma);
+        dgg = slot;
+        params = state.params;
+    }
+    return DCRTPoly(*dgg, params, Format::EVALUATION);
+}
+
+#ifdef SECURE_FL_X86_DISPATCH
+
+// Per-lane popcount of four 64-bit words (nibble lookup, then horizontal byte sum).
+__attribute__((target("avx2")))
+inline __m256i Popcount64Avx2(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    return _mm256_sad_epu8(counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+void SampleCenteredBinomialAvx2(const uint64_t* random, int64_t* out, size_t n, uint32_t eta) {
+    const uint64_t mask = (eta >= 32) ? 0xFFFFFFFFULL : ((1ULL << eta) - 1);
+    const __m256i maskVec = _mm256_set1_epi64x(static_cast<long long>(mask));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(random + i));
+        __m256i a = Popcount64Avx2(_mm256_and_si256(w, maskVec));
+        __m256i b = Popcount64Avx2(_mm256_and_si256(_mm256_srli_epi64(w, 32), maskVec));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_sub_epi64(a, b));
+    }
+    SampleCenteredBinomialScalar(random + i, out + i, n - i, eta);
+}
+
+bool HasAvx2() {
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+}
+
+#endif // SECURE_FL_X86_DISPATCH
+
+} // namespace
+
+void UsePrgGaussianSampler() {
+    g_prgGaussian.store(true);
+}
+
+void SetNoiseSampler(NoiseSamplerKind kind) {
+    g_noiseSampler.store(kind);
+}
+
+NoiseSamplerKind GetNoiseSampler() {
+    return g_noiseSampler.load();
+}
+
+const char* NoiseSamplerName(NoiseSamplerKind kind) {
+    return kind == NoiseSamplerKind::CENTERED_BINOMIAL ? "CenteredBinomial" : "Gaussian";
+}
+
+/**
+ * @brief Samples one noise polynomial with the selected sampler.
+ * @param cc The crypto context whose towers the polynomial spans.
+ * @param sigma Standard deviation of every coefficient.
+ * @return The noise polynomial in EVALUATION format.
+ */
+DCRTPoly SampleNoise(CryptoContext<DCRTPoly>& cc, double sigma) {
+    if (GetNoiseSampler() == NoiseSamplerKind::CENTERED_BINOMIAL) {
+        uint32_t eta = BinomialEta(sigma);
+        if (eta <= MAX_BINOMIAL_ETA) {
+            return SampleBinomial(cc, eta);
+        }
+    }
+    return SampleGaussian(cc, sigma);
+}
+
+/**
+ * @brief Samples the signed coefficients of one noise polynomial, without lifting them.
+ * For callers that lift and transform one tower at a time (see the fused Encrypt).
+ * @param cc The crypto context; only its ring dimension is used.
+ * @param sigma Standard deviation of every coefficient.
+ * @param out Resized to the ring dimension and filled with the samples.
+ */
+void SampleNoiseCoefficients(CryptoContext<DCRTPoly>& cc, double sigma, std::vector<int64_t>& out) {
+    const size_t ringDim = cc->GetRingDimension();
+    out.resize(ringDim);
+
+    uint32_t eta = BinomialEta(sigma);
+    if (GetNoiseSampler() == NoiseSamplerKind::CENTERED_BINOMIAL && eta <= MAX_BINOMIAL_ETA) {
+        NoisePrg prg;
+        uint64_t words[SAMPLE_CHUNK_WORDS];
+        for (size_t offset = 0; offset < ringDim; offset += SAMPLE_CHUNK_WORDS) {
+            const size_t n = std::min(SAMPLE_CHUNK_WORDS, ringDim - offset);
+            prg.Next(words, n);
+            SampleCenteredBinomial(words, out.data() + offset, n, eta);
+        }
+        return;
+    }
+    if (g_prgGaussian.load()) {
+        NoisePrg prg;
+        SamplePrgGaussian(prg, sigma, out.data(), ringDim);
+        return;
+    }
+
+    std::shared_ptr<GaussianGenerator> dgg;
+    {
+        std::lock_guard<std::mutex> lock(g_cacheMutex);
+        auto& slot = GetSamplerState(cc).gaussians[sigma];
+        if (!slot) slot = std::make_shared<GaussianGenerator>(sigma);
+        dgg = slot;
+    }
+    std::shared_ptr<int64_t> samples = dgg->GenerateIntVector(static_cast<usint>(ringDim));
+    std::copy(samples.get(), samples.get() + ringDim, out.begin());
+}
+
+void SampleCenteredBinomialScalar(const uint64_t* random, int64_t* out, size_t n, uint32_t eta) {
+    const uint64_t mask = (eta >= 32) ? 0xFFFFFFFFULL : ((1ULL << eta) - 1);
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<int64_t>(__builtin_popcountll(random[i] & mask)) -
+                 static_cast<int64_t>(__builtin_popcountll((random[i] >> 32) & mask));
+    }
+}
+
+void SampleCenteredBinomial(const uint64_t* random, int64_t* out, size_t n, uint32_t eta) {
+#ifdef SECURE_FL_X86_DISPATCH
+    if (HasAvx2()) {
+        SampleCenteredBinomialAvx2(random, out, n, eta);
+        return;
+    }
+#endif
+    SampleCenteredBinomialScalar(random, out, n, eta);
+}
+
+const char* CenteredBinomialKernelName() {
+#ifdef SECURE_FL_X86_DISPATCH
+    if (HasAvx2()) return "AVX2";
+#endif
+    return "Scalar";
+}
@@ -0,0 +1,49 @@
+// noise_sampler.h
+//
+// Header file for the pluggable noise sampler used by key generation and
+// encryption. The default draws from OpenFHE's discrete Gaussian generator;
+// the centered binomial sampler expands a ChaCha20 stream with a vectorized
+// popcount kernel and writes every RNS tower from a single integer sample.
+
+#ifndef NOISE_SAMPLER_H
+#define NOISE_SAMPLER_H
+
+#include "common.h"
+
+enum class NoiseSamplerKind {
+    GAUSSIAN,         // OpenFHE DiscreteGaussianGenerator (one generator cached per context and sigma).
+    CENTERED_BINOMIAL // Sum of eta coin pairs, eta = round(2 * sigma^2); same variance as the Gaussian.
+};
+
+// Selects the sampler used by SampleNoise() process-wide. GAUSSIAN by default.
+void SetNoiseSampler(NoiseSamplerKind kind);
+NoiseSamplerKind GetNoiseSampler();
+const char* NoiseSamplerName(NoiseSamplerKind kind);
+
+// Draws the Gaussian noise of this process from the same discrete Gaussian as
+// OpenFHE's generator (CDF inversion), but keyed from a fresh OS-seeded
+// ChaCha20 stream per polynomial. OpenFHE's PRNG state is process-global and
+// copied by fork(), so forked siblings would otherwise draw identical noise;
+// call this before forking (or in each child). The centered binomial sampler
+// already keys a new stream per polynomial.
+void UsePrgGaussianSampler();
+
+// Samples a noise polynomial of standard deviation sigma over all towers of
+// `cc`, in EVALUATION format. Safe to call concurrently. Centered binomial
+// sampling needs eta <= 32 (sigma <= 4) and falls back to the Gaussian above that.
+DCRTPoly SampleNoise(CryptoContext<DCRTPoly>& cc, double sigma);
+
+// Fills `out` with the N signed coefficients of one noise polynomial, before
+// any tower lifting or NTT, using the same sampler as SampleNoise().
+void SampleNoiseCoefficients(CryptoContext<DCRTPoly>& cc, double sigma, std::vector<int64_t>& out);
+
+// Maps n 64-bit random words to centered binomial samples with parameter eta
+// (<= 32): out[i] = popcount(lo32 & mask) - popcount(hi32 & mask).
+// The scalar version is the reference; the other dispatches to AVX2 if available.
+void SampleCenteredBinomialScalar(const uint64_t* random, int64_t* out, size_t n, uint32_t eta);
+void SampleCenteredBinomial(const uint64_t* random, int64_t* out, size_t n, uint32_t eta);
+
+// Name of the kernel SampleCenteredBinomial() dispatches to on this CPU.
+const char* CenteredBinomialKernelName();
+
+#endif // NOISE_SAMPLER_H
@@ -0,0 +1,182 @@
+// pack_kernels.cpp
+//
+// Implementation of the bit-packing kernels. Both variants walk a group one
+// row of four values at a time, OR-ing each row into the current output row
+// at a running bit offset and spilling the high bits of a value that
+// straddles a word boundary into the next row. The AVX2 variant does the
+// same with one register per row; it is compiled with a per-function target
+// attribute and selected at runtime, like the reduction kernels.
+
+#include "pack_kernels.h"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SECURE_FL_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t LANES = 4;
+constexpr size_t ROWS = PACK_GROUP_SIZE / LANES; // Values per lane.
+
+uint64_t WidthMask(uint32_t width) {
+    return width == 64 ? ~0ULL : (1ULL << width) - 1;
+}
+
+void PackGroupScalar(const uint64_t* in, uint32_t width, uint64_t* out) {
+    std::memset(out, 0, LANES * width * sizeof(uint64_t));
+    for (size_t k = 0; k < ROWS; ++k) {
+        const size_t bit = k * width;
+        const size_t word = bit / 64;
+        const uint32_t shift = bit % 64;
+        for (size_t l = 0; l < LANES; ++l) {
+            const uint64_t v = in[LANES * k + l];
+            out[LANES * word + l] |= v << shift;
+            if (shift + width > 64) out[LANES * (word + 1) + l] |= v >> (64 - shift);
+        }
+    }
+}
+
+void UnpackGroupScalar(const uint64_t* in, uint32_t width, uint64_t* out) {
+    const uint64_t mask = WidthMask(width);
+    for (size_t k = 0; k < ROWS; ++k) {
+        const size_t bit = k * width;
+        const size_t word = bit / 64;
+        const uint32_t shift = bit % 64;
+        for (size_t l = 0; l < LANES; ++l) {
+            uint64_t v = in[LANES * word + l] >> shift;
+            if (shift + width > 64) v |= in[LANES * (word + 1) + l] << (64 - shift);
+            out[LANES * k + l] = v & mask;
+        }
+    }
+}
+
+// Runs `group` over every full group, and over a zero-padded copy of the last one.
+template <typename GroupFn>
+void PackAll(const uint64_t* in, size_t n, uint32_t width, uint64_t* out, GroupFn group) {
+    const size_t groupWords = LANES * width;
+    size_t g = 0;
+    for (; (g + 1) * PACK_GROUP_SIZE <= n; ++g) {
+        group(in + g * PACK_GROUP_SIZE, width, out + g * groupWords);
+    }
+    if (g * PACK_GROUP_SIZE < n) {
+        uint64_t tail[PACK_GROUP_SIZE] = {};
+        std::memcpy(tail, in + g * PACK_GROUP_SIZE, (n - g * PACK_GROUP_SIZE) * sizeof(uint64_t));
+        group(tail, width, out + g * groupWords);
+    }
+}
+
+template <typename GroupFn>
+void UnpackAll(const uint64_t* in, size_t n, uint32_t width, uint64_t* out, GroupFn group) {
+    const size_t groupWords = LANES * width;
+    size_t g = 0;
+    for (; (g + 1) * PACK_GROUP_SIZE <= n; ++g) {
+        group(in + g * groupWords, width, out + g * PACK_GROUP_SIZE);
+    }
+    if (g * PACK_GROUP_SIZE < n) {
+        uint64_t tail[PACK_GROUP_SIZE];
+        group(in + g * groupWords, width, tail);
+        std::memcpy(out + g * PACK_GROUP_SIZE, tail, (n - g * PACK_GROUP_SIZE) * sizeof(uint64_t));
+    }
+}
+
+#ifdef SECURE_FL_X86_DISPATCH
+
+__attribute__((target("avx2")))
+void PackGroupAvx2(const uint64_t* in, uint32_t width, uint64_t* out) {
+    __m256i row = _mm256_setzero_si256();
+    uint32_t shift = 0;
+    for (size_t k = 0; k < ROWS; ++k) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + LANES * k));
+        row = _mm256_or_si256(row, _mm256_sll_epi64(v, _mm_cvtsi32_si128(shift)));
+        shift += width;
+        if (shift >= 64) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), row);
+            out += LANES;
+            shift -= 64;
+            // The bits of v that did not fit; a shift count of 64 yields zero.
+            row = _mm256_srl_epi64(v, _mm_cvtsi32_si128(width - shift));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void UnpackGroupAvx2(const uint64_t* in, uint32_t width, uint64_t* out) {
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(WidthMask(width)));
+    __m256i row = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    uint32_t shift = 0;
+    for (size_t k = 0; k < ROWS; ++k) {
+        __m256i v = _mm256_srl_epi64(row, _mm_cvtsi32_si128(shift));
+        shift += width;
+        if (shift >= 64) {
+            shift -= 64;
+            in += LANES;
+            // The last row of the group ends exactly on a word boundary: nothing to load.
+            if (k + 1 < ROWS) {
+                row = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+                if (shift > 0) {
+                    v = _mm256_or_si256(v, _mm256_sll_epi64(row, _mm_cvtsi32_si128(width - shift)));
+                }
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + LANES * k), _mm256_and_si256(v, mask));
+    }
+}
+
+#endif // SECURE_FL_X86_DISPATCH
+
+PackKernel DetectPackKernel() {
+#ifdef SECURE_FL_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return PackKernel::AVX2;
+#endif
+    return PackKernel::SCALAR;
+}
+
+} // namespace
+
+uint32_t PackedWidth(uint64_t q) {
+    return q <= 2 ? 1 : 64 - static_cast<uint32_t>(__builtin_clzll(q - 1));
+}
+
+size_t PackedWords(size_t n, uint32_t width) {
+    return (n + PACK_GROUP_SIZE - 1) / PACK_GROUP_SIZE * LANES * width;
+}
+
+void PackBitsScalar(const uint64_t* in, size_t n, uint32_t width, uint64_t* out) {
+    PackAll(in, n, width, out, PackGroupScalar);
+}
+
+void UnpackBitsScalar(const uint64_t* in, size_t n, uint32_t width, uint64_t* out) {
+    UnpackAll(in, n, width, out, UnpackGroupScalar);
+}
+
+PackKernel GetActivePackKernel() {
+    static const PackKernel kernel = DetectPackKernel();
+    return kernel;
+}
+
+const char* PackKernelName(PackKernel kernel) {
+    return kernel == PackKernel::AVX2 ? "AVX2" : "Scalar";
+}
+
+void PackBits(const uint64_t* in, size_t n, uint32_t width, uint64_t* out) {
+#ifdef SECURE_FL_X86_DISPATCH
+    if (GetActivePackKernel() == PackKernel::AVX2) {
+        PackAll(in, n, width, out, PackGroupAvx2);
+        return;
+    }
+#endif
+    PackBitsScalar(in, n, width, out);
+}
+
+void UnpackBits(const uint64_t* in, size_t n, uint32_t width, uint64_t* out) {
+#ifdef SECURE_FL_X86_DISPATCH
+    if (GetActivePackKernel() == PackKernel::AVX2) {
+        UnpackAll(in, n, width, out, UnpackGroupAvx2);
+        return;
+    }
+#endif
+    UnpackBitsScalar(in, n, width, out);
+}
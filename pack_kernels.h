@@ -0,0 +1,46 @@
+// pack_kernels.h
+//
+// Header file for the bit-packing kernels of the packed share encoding. Share
+// coefficients lie in [0, q) for 50-60 bit moduli, so storing them as 64-bit
+// words wastes 4-14 bits each; these kernels store every coefficient in
+// exactly `width` bits.
+
+#ifndef PACK_KERNELS_H
+#define PACK_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Identifies which implementation PackBits()/UnpackBits() dispatch to on this CPU.
+enum class PackKernel {
+    SCALAR,
+    AVX2
+};
+
+// Coefficients are packed in groups of PACK_GROUP_SIZE = 4 lanes x 64 values.
+// Value k of a group belongs to lane k % 4; each lane is a bitstream of its
+// 64 values at `width` bits (LSB first), i.e. exactly `width` words, and word
+// j of lane l is stored at 4 * j + l. All four lanes share the same bit
+// offsets, so a 256-bit register packs or unpacks a whole row at once. A
+// short last group is padded with zeros.
+constexpr size_t PACK_GROUP_SIZE = 256;
+
+// Bits needed for values in [0, q): ceil(log2 q), at least 1.
+uint32_t PackedWidth(uint64_t q);
+// Words that PackBits writes for n values of `width` bits.
+size_t PackedWords(size_t n, uint32_t width);
+
+// Packs n values (each < 2^width, 1 <= width <= 64) into PackedWords(n, width)
+// words. This is the portable reference implementation.
+void PackBitsScalar(const uint64_t* in, size_t n, uint32_t width, uint64_t* out);
+void UnpackBitsScalar(const uint64_t* in, size_t n, uint32_t width, uint64_t* out);
+
+// Same layout as the scalar versions, using AVX2 when the CPU supports it.
+void PackBits(const uint64_t* in, size_t n, uint32_t width, uint64_t* out);
+void UnpackBits(const uint64_t* in, size_t n, uint32_t width, uint64_t* out);
+
+// Returns the kernel selected by runtime CPU detection.
+PackKernel GetActivePackKernel();
+const char* PackKernelName(PackKernel kernel);
+
+#endif // PACK_KERNELS_H
@@ -0,0 +1,75 @@
+// parallel.h
+//
+// Small OpenMP helpers shared by the harness and the crypto engines. Every
+// helper degrades to a plain sequential loop when the build has no OpenMP.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <exception>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ * @brief Resolves a configured thread count to the number actually used.
+ * 0 means "all available cores"; without OpenMP this is always 1.
+ */
+inline int ResolveThreadCount(int requested) {
+#ifdef _OPENMP
+    return requested > 0 ? requested : omp_get_max_threads();
+#else
+    (void)requested;
+    return 1;
+#endif
+}
+
+/**
+ * @brief Index of the calling thread within the innermost OpenMP team (0 outside one).
+ * Inside ParallelFor(n, numThreads, ...) this is in [0, numThreads).
+ */
+inline int CurrentThreadIndex() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Runs body(i) for every i in [0, n) across `numThreads` OpenMP threads.
+ * With `dynamicSchedule` false each thread gets one contiguous block of indices;
+ * otherwise indices are handed out one at a time for load balancing. An
+ * exception thrown by any iteration is captured and rethrown on the calling
+ * thread once the loop has finished, since it cannot cross the OpenMP region.
+ */
+template <typename Body>
+void ParallelFor(int n, int numThreads, Body body, bool dynamicSchedule = false) {
+    std::exception_ptr error = nullptr;
+    auto guarded = [&](int i) {
+        try {
+            body(i);
+        } catch (...) {
+#ifdef _OPENMP
+            #pragma omp critical(parallel_for_error)
+#endif
+            if (!error) error = std::current_exception();
+        }
+    };
+#ifdef _OPENMP
+    if (dynamicSchedule) {
+        #pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+        for (int i = 0; i < n; ++i) guarded(i);
+    } else {
+        #pragma omp parallel for schedule(static) num_threads(numThreads)
+        for (int i = 0; i < n; ++i) guarded(i);
+    }
+#else
+    (void)numThreads;
+    (void)dynamicSchedule;
+    for (int i = 0; i < n; ++i) guarded(i);
+#endif
+    if (error) std::rethrow_exception(error);
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,121 @@
+// param_tuner.cpp
+//
+// Implementation of the CKKS parameter tuner.
+
+#include "param_tuner.h"
+#include "mk_ckks.h"
+
+namespace {
+
+// Gaussian width of fresh encryption noise in the contexts BuildContext creates:
+// OpenFHE's default, which the built context reports as GetDistributionParameter().
+double DefaultSigma() {
+    return CCParams<CryptoContextCKKSRNS>().GetStandardDeviation();
+}
+// Native-integer towers must stay below 2^60.
+const uint32_t MAX_MOD_SIZE = 60;
+// Largest ring dimension the tuner will consider.
+const uint32_t MAX_RING_DIM = 2 * MAX_BATCH_SIZE;
+// Tail bound used for every "maximum over many samples" estimate.
+const double TAIL = 6.0;
+
+CryptoContext<DCRTPoly> BuildContext(uint32_t ringDim, uint32_t batchSize, uint32_t multDepth,
+                                     uint32_t scalingModSize, uint32_t firstModSize) {
+    CCParams<CryptoContextCKKSRNS> parameters;
+    parameters.SetRingDim(ringDim);
+    parameters.SetMultiplicativeDepth(multDepth);
+    parameters.SetScalingModSize(scalingModSize);
+    parameters.SetFirstModSize(firstModSize);
+    parameters.SetBatchSize(batchSize);
+    parameters.SetSecurityLevel(HEStd_128_classic);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    return cc;
+}
+
+} // namespace
+
+/**
+ * @brief Predicts the largest slot error of the decoded aggregate.
+ * Per client, the decoded polynomial carries v*e + e0 + e1*s + e* plus the
+ * encoding rounding error, where v, e, e0, e1 and s all have variance sigma^2
+ * (the secret is sampled like the noise in KeyGenSingle). Summing n
+ * independent clients adds variances; the canonical embedding maps a
+ * coefficient variance V to a real-part slot variance N*V/2, and the maximum
+ * over all slots is bounded by a 6-sigma tail.
+ * @param numClients Number of shares in the sum.
+ * @param ringDim Ring dimension N.
+ * @param scalingFactor The encoding scale Delta.
+ * @param sigma Standard deviation of the encryption noise.
+ * @return The predicted max |decoded - exact| over all slots.
+ */
+double PredictAggregateError(uint32_t numClients, uint32_t ringDim, double scalingFactor,
+                             double sigma) {
+    const double n = ringDim;
+    const double sigma2 = sigma * sigma;
+    const double sigmaStar2 = E_STAR_SIGMA * E_STAR_SIGMA;
+    const double perClient = 2.0 * n * sigma2 * sigma2 + sigma2 + sigmaStar2 + 1.0 / 12.0;
+    const double slotStdDev = std::sqrt(numClients * perClient * n / 2.0);
+    return TAIL * slotStdDev / scalingFactor;
+}
+
+/**
+ * @brief Selects the cheapest secure CKKS parameter set for one aggregation.
+ * Smaller rings are cheaper and also accumulate less noise, so candidates are
+ * tried in increasing ring dimension and the first valid one wins.
+ */
+TunedParameters TuneParameters(const TuningRequest& request) {
+    const uint32_t batchSize = std::min(next_power_of_2(SlotsForData(request.dataSize, request.slotPacking)),
+                                        MAX_BATCH_SIZE);
+    const double slotMagnitude = SlotMagnitude(request.maxAbs, request.slotPacking);
+    const double sumBits = std::log2(request.numClients * slotMagnitude);
+    const double sigma = DefaultSigma();
+    std::string lastError = "no candidate ring dimension";
+
+    for (uint32_t ringDim = std::max<uint32_t>(2 * batchSize, 1024); ringDim <= MAX_RING_DIM; ringDim <<= 1) {
+        // Delta must lift the summed noise at least precisionBits above 1.
+        double noiseBits = std::log2(PredictAggregateError(request.numClients, ringDim, 1.0, sigma));
+        uint32_t scalingModSize = static_cast<uint32_t>(std::ceil(noiseBits + request.precisionBits));
+        if (scalingModSize >= MAX_MOD_SIZE) {
+            // Noise only grows with the ring, so larger rings cannot help.
+            lastError = "target precision needs a scaling modulus of " + std::to_string(scalingModSize) + " bits";
+            break;
+        }
+        // Ideally q_0 alone holds Delta * n * maxAbs (centered, with one bit of
+        // slack), so a single tower is enough to upload.
+        uint32_t firstModSize = std::min<uint32_t>(
+            MAX_MOD_SIZE, static_cast<uint32_t>(std::ceil(scalingModSize + sumBits + 2.0)));
+
+        TunedParameters tuned;
+        try {
+            tuned.cc = BuildContext(ringDim, batchSize, 1, scalingModSize, firstModSize);
+        } catch (const std::exception& e) {
+            // Typically: too much modulus for this ring under HEStd_128_classic.
+            lastError = e.what();
+            continue;
+        }
+
+        auto cryptoParams = std::dynamic_pointer_cast<const CryptoParametersRNS>(tuned.cc->GetCryptoParameters());
+        Plaintext probe = tuned.cc->MakeCKKSPackedPlaintext(std::vector<double>{0.0});
+
+        tuned.ringDim = ringDim;
+        tuned.batchSize = batchSize;
+        tuned.multDepth = 1;
+        tuned.scalingModSize = scalingModSize;
+        tuned.firstModSize = firstModSize;
+        tuned.numTowers = cryptoParams->GetElementParams()->GetParams().size();
+        tuned.uploadTowers = request.reduceTowers
+            ? MinimalTowerCount(tuned.cc, request.numClients, slotMagnitude)
+            : tuned.numTowers;
+        tuned.predictedMaxError = PredictAggregateError(request.numClients, ringDim, probe->GetScalingFactor(),
+                                                        cryptoParams->GetDistributionParameter());
+        tuned.numChunks = NumChunks(request.dataSize, ChunkCapacity(tuned.cc, request.slotPacking));
+        size_t polyBytes = static_cast<size_t>(tuned.uploadTowers) * ringDim * sizeof(uint64_t);
+        size_t chunkBytes = (request.shareFormat == ShareFormat::COMPACT) ? polyBytes : 2 * polyBytes;
+        tuned.predictedShareBytes = tuned.numChunks * chunkBytes;
+        return tuned;
+    }
+
+    throw std::runtime_error("Parameter tuning failed for " + std::to_string(request.numClients) +
+                             " clients, d=" + std::to_string(request.dataSize) + ": " + lastError);
+}
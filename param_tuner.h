@@ -0,0 +1,51 @@
+// param_tuner.h
+//
+// Header file for the CKKS parameter tuner. Given the shape of an aggregation
+// (client count, vector length, value range) and a target precision, it picks
+// the cheapest parameter set that OpenFHE accepts as 128-bit secure.
+
+#ifndef PARAM_TUNER_H
+#define PARAM_TUNER_H
+
+#include "common.h"
+
+// What the aggregation needs to support.
+struct TuningRequest {
+    uint32_t numClients{1};
+    uint32_t dataSize{1};
+    double maxAbs{1.0};         // Every client value lies in [-maxAbs, maxAbs].
+    uint32_t precisionBits{20}; // Target: max error of the decoded sum <= 2^-precisionBits.
+    ShareFormat shareFormat{ShareFormat::SPLIT};
+    bool reduceTowers{true};    // Shares are cut to MinimalTowerCount before upload.
+    SlotPacking slotPacking{SlotPacking::REAL};
+};
+
+// The selected parameters, the context built from them and the predicted cost.
+struct TunedParameters {
+    uint32_t ringDim{0};
+    uint32_t batchSize{0};
+    uint32_t multDepth{1};
+    uint32_t scalingModSize{0};
+    uint32_t firstModSize{0};
+    uint32_t numTowers{0};          // Towers in the full modulus.
+    uint32_t uploadTowers{0};       // Towers each client actually uploads.
+    uint32_t numChunks{1};          // Ciphertexts per client update (see ChunkCapacity).
+    double predictedMaxError{0.0};  // Predicted max |decoded - exact| over all slots.
+    size_t predictedShareBytes{0};  // Raw coefficient bytes of one client's upload (all chunks).
+    CryptoContext<DCRTPoly> cc;
+};
+
+// Candidate ring dimensions are tried from smallest (cheapest) up. For each,
+// the scaling modulus is sized from the summed noise and the target precision,
+// the first modulus from the magnitude of the sum, and the context is built;
+// OpenFHE rejects sets below the 128-bit HE-standard bound, so the first one
+// that builds is both the cheapest and secure.
+// Updates longer than MAX_BATCH_SIZE slots are split into several ciphertexts.
+// Throws std::runtime_error if no ring dimension up to 2^17 works.
+TunedParameters TuneParameters(const TuningRequest& request);
+
+// Predicted max error of the decoded sum for a given ring dimension and scale.
+double PredictAggregateError(uint32_t numClients, uint32_t ringDim, double scalingFactor,
+                             double sigma);
+
+#endif // PARAM_TUNER_H
@@ -0,0 +1,120 @@
+// reduce_kernels.cpp
+//
+// Implementation of the keystream reduction kernels. Reducing with `x % q`
+// costs a 64-bit division per coefficient; instead each word is mapped with
+// Lemire's multiply-shift floor(x * q / 2^64), which needs only the high half
+// of a 64x64-bit product. The SIMD kernels build that high half out of 32-bit
+// multiplies, using the 32-bit halves of q precomputed once per call (i.e. per
+// tower). Each variant is compiled with a per-function target attribute and
+// selected at runtime, so the binary still runs on CPUs without AVX.
+
+#include "reduce_kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SECURE_FL_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+void ReduceKeystreamScalar(const uint64_t* in, uint64_t* out, size_t n, uint64_t q) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = static_cast<uint64_t>((static_cast<unsigned __int128>(in[i]) * q) >> 64);
+    }
+}
+
+#ifdef SECURE_FL_X86_DISPATCH
+
+// High 64 bits of x * q per lane, where q = qHi * 2^32 + qLo.
+__attribute__((target("avx2")))
+static inline __m256i MulHi64Avx2(__m256i x, __m256i qLo, __m256i qHi) {
+    const __m256i lowMask = _mm256_set1_epi64x(0xFFFFFFFFULL);
+    __m256i xHi = _mm256_srli_epi64(x, 32);
+
+    __m256i ll = _mm256_mul_epu32(x, qLo);
+    __m256i lh = _mm256_mul_epu32(x, qHi);
+    __m256i hl = _mm256_mul_epu32(xHi, qLo);
+    __m256i hh = _mm256_mul_epu32(xHi, qHi);
+
+    // Carry out of the middle 32-bit column; at most 34 bits, so no overflow.
+    __m256i mid = _mm256_add_epi64(_mm256_srli_epi64(ll, 32),
+                  _mm256_add_epi64(_mm256_and_si256(lh, lowMask), _mm256_and_si256(hl, lowMask)));
+
+    __m256i hi = _mm256_add_epi64(hh, _mm256_srli_epi64(lh, 32));
+    hi = _mm256_add_epi64(hi, _mm256_srli_epi64(hl, 32));
+    return _mm256_add_epi64(hi, _mm256_srli_epi64(mid, 32));
+}
+
+__attribute__((target("avx2")))
+static void ReduceKeystreamAvx2(const uint64_t* in, uint64_t* out, size_t n, uint64_t q) {
+    const __m256i qLo = _mm256_set1_epi64x(static_cast<long long>(q & 0xFFFFFFFFULL));
+    const __m256i qHi = _mm256_set1_epi64x(static_cast<long long>(q >> 32));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), MulHi64Avx2(x, qLo, qHi));
+    }
+    ReduceKeystreamScalar(in + i, out + i, n - i, q);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i MulHi64Avx512(__m512i x, __m512i qLo, __m512i qHi) {
+    const __m512i lowMask = _mm512_set1_epi64(0xFFFFFFFFULL);
+    __m512i xHi = _mm512_srli_epi64(x, 32);
+
+    __m512i ll = _mm512_mul_epu32(x, qLo);
+    __m512i lh = _mm512_mul_epu32(x, qHi);
+    __m512i hl = _mm512_mul_epu32(xHi, qLo);
+    __m512i hh = _mm512_mul_epu32(xHi, qHi);
+
+    __m512i mid = _mm512_add_epi64(_mm512_srli_epi64(ll, 32),
+                  _mm512_add_epi64(_mm512_and_si512(lh, lowMask), _mm512_and_si512(hl, lowMask)));
+
+    __m512i hi = _mm512_add_epi64(hh, _mm512_srli_epi64(lh, 32));
+    hi = _mm512_add_epi64(hi, _mm512_srli_epi64(hl, 32));
+    return _mm512_add_epi64(hi, _mm512_srli_epi64(mid, 32));
+}
+
+__attribute__((target("avx512f")))
+static void ReduceKeystreamAvx512(const uint64_t* in, uint64_t* out, size_t n, uint64_t q) {
+    const __m512i qLo = _mm512_set1_epi64(static_cast<long long>(q & 0xFFFFFFFFULL));
+    const __m512i qHi = _mm512_set1_epi64(static_cast<long long>(q >> 32));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_loadu_si512(in + i);
+        _mm512_storeu_si512(out + i, MulHi64Avx512(x, qLo, qHi));
+    }
+    ReduceKeystreamScalar(in + i, out + i, n - i, q);
+}
+
+#endif // SECURE_FL_X86_DISPATCH
+
+static ReduceKernel DetectReduceKernel() {
+#ifdef SECURE_FL_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return ReduceKernel::AVX512;
+    if (__builtin_cpu_supports("avx2")) return ReduceKernel::AVX2;
+#endif
+    return ReduceKernel::SCALAR;
+}
+
+ReduceKernel GetActiveReduceKernel() {
+    static const ReduceKernel kernel = DetectReduceKernel();
+    return kernel;
+}
+
+const char* ReduceKernelName(ReduceKernel kernel) {
+    switch (kernel) {
+        case ReduceKernel::AVX512: return "AVX-512";
+        case ReduceKernel::AVX2:   return "AVX2";
+        default:                   return "Scalar";
+    }
+}
+
+void ReduceKeystream(const uint64_t* in, uint64_t* out, size_t n, uint64_t q) {
+    switch (GetActiveReduceKernel()) {
+#ifdef SECURE_FL_X86_DISPATCH
+        case ReduceKernel::AVX512: ReduceKeystreamAvx512(in, out, n, q); return;
+        case ReduceKernel::AVX2:   ReduceKeystreamAvx2(in, out, n, q); return;
+#endif
+        default:                   ReduceKeystreamScalar(in, out, n, q); return;
+    }
+}
@@ -0,0 +1,31 @@
+// reduce_kernels.h
+//
+// Header file for the modular reduction kernels used by the masking PRG. They
+// map raw 64-bit ChaCha20 keystream words into [0, q) for an RNS tower modulus q.
+
+#ifndef REDUCE_KERNELS_H
+#define REDUCE_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Identifies which implementation ReduceKeystream() dispatches to on this CPU.
+enum class ReduceKernel {
+    SCALAR,
+    AVX2,
+    AVX512
+};
+
+// Maps n keystream words into [0, q) with Lemire's multiply-shift,
+// out[i] = floor(in[i] * q / 2^64). `in` and `out` may alias.
+// This is the portable reference implementation.
+void ReduceKeystreamScalar(const uint64_t* in, uint64_t* out, size_t n, uint64_t q);
+
+// Same mapping as ReduceKeystreamScalar, using the widest SIMD kernel the CPU supports.
+void ReduceKeystream(const uint64_t* in, uint64_t* out, size_t n, uint64_t q);
+
+// Returns the kernel selected by runtime CPU detection.
+ReduceKernel GetActiveReduceKernel();
+const char* ReduceKernelName(ReduceKernel kernel);
+
+#endif // REDUCE_KERNELS_H
@@ -4,6 +4,8 @@
 
 #include "server.h"
 #include "mk_ckks.h" // Include the crypto engine
+#include "parallel.h"
+#include "aggregate_kernels.h"
 
 // A simple timer utility.
 class Timer {
@@ -23,52 +25,214 @@ private:
 };
 
 
-Server::Server() {}
+Server::Server(AggregationMode mode, uint32_t numChunks, int numWorkers)
+    : m_mode(mode), m_numWorkers(ResolveThreadCount(numWorkers)) {
+    if (numChunks == 0) {
+        throw std::invalid_argument("A server needs at least one chunk");
+    }
+    for (uint32_t c = 0; c < numChunks; ++c) {
+        m_chunks.push_back(std::make_unique<ChunkState>());
+        // One stripe per worker plus the shared, locked one.
+        m_chunks.back()->stripes.resize(m_numWorkers + 1);
+    }
+}
+
+Server::ChunkState& Server::chunkFor(uint32_t chunkIndex) {
+    if (chunkIndex >= m_chunks.size()) {
+        throw std::out_of_range("Share for chunk " + std::to_string(chunkIndex) +
+                                " but the server aggregates " + std::to_string(m_chunks.size()));
+    }
+    return *m_chunks[chunkIndex];
+}
+
+Server::Stripe& Server::stripeFor(uint32_t chunkIndex, int worker) {
+    if (worker < 0 || worker >= m_numWorkers) {
+        throw std::out_of_range("Worker " + std::to_string(worker) + " but the server has " +
+                                std::to_string(m_numWorkers) + " ingest workers");
+    }
+    return chunkFor(chunkIndex).stripes[worker];
+}
+
+void Server::collectShare(const ClientShare& share, int worker) {
+    foldShare(share, stripeFor(share.chunkIndex, worker));
+}
+
+void Server::setWireContext(const std::shared_ptr<DCRTPoly::Params>& contextParams, uint64_t contextId) {
+    m_wireParams = contextParams;
+    m_wireContextId = contextId;
+}
+
+void Server::collectShare(const ShareWireView& view, int worker) {
+    if (!m_wireParams) {
+        throw std::runtime_error("Server::setWireContext must be called before collecting wire shares");
+    }
+    view.expectContext(m_wireContextId);
+    Stripe& stripe = stripeFor(view.header().chunkIndex, worker);
+    if (m_mode == AggregationMode::BUFFERED) {
+        foldShare(DeserializeShareWire(view, m_wireParams), stripe);
+        return;
+    }
+
+    Timer timer;
+    timer.Start();
+    if (stripe.numShares == 0) {
+        // The stripe's first share: start from zero over the uploaded towers.
+        stripe.accumulator = DCRTPoly(m_wireParams, Format::EVALUATION, true);
+        stripe.accumulator.DropLastElements(
+            static_cast<uint32_t>(m_wireParams->GetParams().size()) - view.header().numTowers);
+    }
+    AccumulateShareWire(view, stripe.accumulator);
+    stripe.streamingAggregateMs += timer.Stop();
+    ++stripe.numShares;
+}
 
 void Server::collectShare(const ClientShare& share) {
-    m_clientShares.push_back(share);
+    ChunkState& chunk = chunkFor(share.chunkIndex);
+    std::lock_guard<std::mutex> lock(chunk.mutex);
+    foldShare(share, chunk.stripes.back());
 }
 
-// This function performs the homomorphic additions on the collected shares.
-DCRTPoly Server::aggregateShares() {
-    if (m_clientShares.empty()) {
-        throw std::runtime_error("No client shares to aggregate.");
+void Server::foldShare(const ClientShare& share, Stripe& stripe) {
+    if (m_mode == AggregationMode::BUFFERED) {
+        stripe.shares.push_back(share);
+        ++stripe.numShares;
+        return;
     }
 
-    // Sum all the c0 components from each client's ciphertext.
-    DCRTPoly result_c0 = m_clientShares[0].c0;
-    for (size_t i = 1; i < m_clientShares.size(); ++i) {
-        result_c0 += m_clientShares[i].c0;
+    // STREAMING: fold the share into the running sum so that memory stays
+    // constant in the number of clients. Both components go into a single
+    // accumulator, since only Sum(c0_i) + Sum(d_masked_i) is ever decoded.
+    // A COMPACT share has already been summed by the client: one pass only.
+    Timer timer;
+    timer.Start();
+    if (stripe.numShares == 0) {
+        stripe.accumulator = share.c0;
+    } else {
+        stripe.accumulator += share.c0;
     }
+    if (share.format == ShareFormat::SPLIT) {
+        stripe.accumulator += share.d_masked;
+    }
+    stripe.streamingAggregateMs += timer.Stop();
+    ++stripe.numShares;
+}
+
+void Server::reset() {
+    for (auto& chunk : m_chunks) {
+        std::lock_guard<std::mutex> lock(chunk->mutex);
+        for (Stripe& stripe : chunk->stripes) {
+            stripe.shares.clear();
+            stripe.accumulator = DCRTPoly();
+            stripe.numShares = 0;
+            stripe.streamingAggregateMs = 0.0;
+        }
+    }
+}
+
+size_t Server::getNumShares() const {
+    size_t complete = SIZE_MAX;
+    for (const auto& chunk : m_chunks) {
+        size_t received = 0;
+        for (const Stripe& stripe : chunk->stripes) {
+            received += stripe.numShares;
+        }
+        complete = std::min(complete, received);
+    }
+    return complete;
+}
 
-    // Sum all the masked d components from each client's share.
+int Server::getNumWorkers() const {
+    return m_numWorkers;
+}
+
+// This function performs the homomorphic additions on the collected shares of one chunk.
+DCRTPoly Server::aggregateShares(ChunkState& chunk, int numThreads) {
+    if (m_mode == AggregationMode::STREAMING) {
+        // Most of the work was already done in collectShare(); what is left is
+        // merging the per-worker partial sums. The first tree level writes into
+        // fresh polynomials, so the stripes stay intact.
+        std::vector<const DCRTPoly*> partials;
+        for (const Stripe& stripe : chunk.stripes) {
+            if (stripe.numShares > 0) partials.push_back(&stripe.accumulator);
+        }
+        if (partials.empty()) {
+            throw std::runtime_error("No client shares to aggregate.");
+        }
+        std::vector<DCRTPoly> level((partials.size() + 1) / 2);
+        ParallelFor(static_cast<int>(level.size()), numThreads, [&](int p) {
+            const size_t i = 2 * static_cast<size_t>(p);
+            level[p] = (i + 1 < partials.size()) ? *partials[i] + *partials[i + 1] : *partials[i];
+        });
+        for (size_t step = 1; step < level.size(); step *= 2) {
+            const int pairs = static_cast<int>((level.size() + 2 * step - 1) / (2 * step));
+            ParallelFor(pairs, numThreads, [&](int p) {
+                const size_t i = 2 * step * static_cast<size_t>(p);
+                if (i + step < level.size()) level[i] += level[i + step];
+            });
+        }
+        return std::move(level[0]);
+    }
+
+    // Sum all c0 components and all masked d components in one n-way pass.
     // The masks are designed to sum to zero, leaving the sum of partial decryptions.
-    DCRTPoly result_d_masked = m_clientShares[0].d_masked;
-    for (size_t i = 1; i < m_clientShares.size(); ++i) {
-        result_d_masked += m_clientShares[i].d_masked;
+    // COMPACT shares carry d_masked inside c0 and contribute one polynomial.
+    std::vector<const DCRTPoly*> polys;
+    for (const Stripe& stripe : chunk.stripes) {
+        for (const ClientShare& share : stripe.shares) {
+            polys.push_back(&share.c0);
+            if (share.format == ShareFormat::SPLIT) {
+                polys.push_back(&share.d_masked);
+            }
+        }
+    }
+    if (polys.empty()) {
+        throw std::runtime_error("No client shares to aggregate.");
     }
-    
+
     // The final raw polynomial is Sum(c0_i) + Sum(d_masked_i).
     // This is equivalent to Sum(c0_i + d_i), which decrypts to Sum(m_i).
-    return result_c0 + result_d_masked;
+    return SumPolynomials(polys, numThreads);
 }
 
 // MODIFIED: The function now returns a ServerResult struct and measures performance.
-ServerResult Server::getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize) {
+ServerResult Server::getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize, SlotPacking packing) {
     ServerResult result;
     Timer timer;
+    const int numChunks = static_cast<int>(m_chunks.size());
+    const int numThreads = ResolveThreadCount(0);
+    const uint32_t capacity = ChunkCapacity(cc, packing);
 
     // --- 1. Measure Share Aggregation Time (T_aggregate) ---
+    std::vector<DCRTPoly> finalPolys(numChunks);
     timer.Start();
-    DCRTPoly finalPoly = aggregateShares();
+    // One chunk at a time: each merge is already parallel (over tree pairs, or
+    // over towers and coefficient blocks), which keeps every core busy even
+    // with a single chunk.
+    for (int c = 0; c < numChunks; ++c) {
+        finalPolys[c] = aggregateShares(*m_chunks[c], numThreads);
+    }
     result.timings.t_aggregate_ms = timer.Stop();
-    // std::cout << "Server has aggregated all shares." << std::endl; // Moved to main loop
+    // When streaming, the additions happened as shares arrived; report that
+    // accumulated time so the logs stay comparable with BUFFERED runs.
+    if (m_mode == AggregationMode::STREAMING) {
+        for (const auto& chunk : m_chunks) {
+            for (const Stripe& stripe : chunk->stripes) {
+                result.timings.t_aggregate_ms += stripe.streamingAggregateMs;
+            }
+        }
+    }
 
     // --- 2. Measure Final Decoding Time (T_decode) ---
+    // Every chunk decodes into its own slice of the result.
+    result.final_aggregated_vector.assign(dataSize, 0.0);
     timer.Start();
-    result.final_aggregated_vector = Decode(finalPoly, cc, dataSize);
+    ParallelFor(numChunks, numThreads, [&](int c) {
+        const uint32_t begin = std::min(dataSize, c * capacity);
+        const uint32_t length = std::min(capacity, dataSize - begin);
+        std::vector<double> values = Decode(finalPolys[c], cc, length, packing);
+        std::copy(values.begin(), values.end(), result.final_aggregated_vector.begin() + begin);
+    });
     result.timings.t_decode_ms = timer.Stop();
-    // std::cout << "Server has decoded the final result." << std::endl; // Moved to main loop
-    
+
     return result;
 }
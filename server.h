@@ -6,23 +6,91 @@
 #define SERVER_H
 
 #include "common.h"
+#include "share_wire.h"
+#include <mutex>
+
+// Selects how the server holds client shares until the final result is requested.
+enum class AggregationMode {
+    BUFFERED,  // Store every ClientShare and sum them in getFinalResult (O(n) memory).
+    STREAMING  // Fold each share into a running accumulator on arrival (O(1) memory).
+};
 
 class Server {
 public:
-    Server();
+    // `numChunks` is the number of ciphertexts per client update (see Client::prepareTensorShares).
+    // `numWorkers` is the number of ingest threads that call collectShare with a
+    // worker index; each owns a private accumulator. 0 = ResolveThreadCount(0).
+    explicit Server(AggregationMode mode = AggregationMode::STREAMING, uint32_t numChunks = 1,
+                    int numWorkers = 0);
+
+    // Concurrent ingest: folds the share into the private accumulator (or share
+    // list, when BUFFERED) of `worker`, without taking any lock. Each worker
+    // index in [0, numWorkers) must be used by at most one thread at a time,
+    // e.g. the OpenMP thread number (CurrentThreadIndex() in parallel.h).
+    void collectShare(const ClientShare& share, int worker);
 
-    // Collects a share from a client.
+    // Collects a share from a client. Safe to call concurrently from any thread,
+    // alongside the worker version: these shares go into one extra, locked
+    // accumulator per chunk.
     void collectShare(const ClientShare& share);
 
+    // Accepts shares in the flat wire format (share_wire.h) from the context
+    // with element parameters `contextParams` and id `contextId`. Required
+    // before the first collectShare(const ShareWireView&, int).
+    void setWireContext(const std::shared_ptr<DCRTPoly::Params>& contextParams, uint64_t contextId);
+
+    // Concurrent ingest of a serialized share, like collectShare(share, worker).
+    // When STREAMING the coefficients are summed straight from the buffer,
+    // without building a DCRTPoly per share.
+    void collectShare(const ShareWireView& view, int worker);
+
     // MODIFIED: Orchestrates the aggregation and final decoding.
     // Returns a ServerResult struct containing the final vector and timings.
-    ServerResult getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize);
+    // `packing` must match the clients' encoding. The per-worker partial sums
+    // are merged by a parallel tree reduction; chunks are then decoded in
+    // parallel and concatenated into one vector of dataSize values.
+    // Must not run concurrently with collectShare.
+    ServerResult getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize,
+                                SlotPacking packing = SlotPacking::REAL);
+
+    // Discards all collected shares so the same server can aggregate the next round.
+    void reset();
+
+    // Number of complete client contributions (shares received for every chunk).
+    // Only exact once ingestion has finished.
+    size_t getNumShares() const;
+    int getNumWorkers() const;
 
 private:
-    // Internal helper to perform the aggregation.
-    DCRTPoly aggregateShares();
+    // One worker's private slice of a chunk. Aligned to a cache line so the
+    // counters of neighbouring workers never share one.
+    struct alignas(64) Stripe {
+        std::vector<ClientShare> shares; // BUFFERED mode: every share this worker received.
+        DCRTPoly accumulator;            // STREAMING mode: this worker's Sum(c0_i + d_masked_i).
+        size_t numShares{0};
+        double streamingAggregateMs{0.0}; // Time spent folding into the accumulator.
+    };
+
+    // Per-chunk aggregation state: one stripe per worker, plus a last, shared
+    // stripe for collectShare calls without a worker index (guarded by `mutex`).
+    struct ChunkState {
+        std::mutex mutex;
+        std::vector<Stripe> stripes;
+    };
+
+    ChunkState& chunkFor(uint32_t chunkIndex);
+    Stripe& stripeFor(uint32_t chunkIndex, int worker);
+    void foldShare(const ClientShare& share, Stripe& stripe);
+
+    // Internal helper to perform the aggregation of one chunk: the tree
+    // reduction of its stripe accumulators, or SumPolynomials over all buffered shares.
+    DCRTPoly aggregateShares(ChunkState& chunk, int numThreads);
 
-    std::vector<ClientShare> m_clientShares;
+    AggregationMode m_mode;
+    int m_numWorkers;
+    std::vector<std::unique_ptr<ChunkState>> m_chunks;
+    std::shared_ptr<DCRTPoly::Params> m_wireParams; // Set by setWireContext.
+    uint64_t m_wireContextId{0};
 };
 
 #endif // SERVER_H
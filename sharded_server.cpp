@@ -0,0 +1,346 @@
+// sharded_server.cpp
+//
+// Implementation of the sharded aggregation server: the shard process loop,
+// the coordinator's routing, and the small length-prefixed message protocol
+// between them.
+
+#include "sharded_server.h"
+#include "mk_ckks.h"
+#include "parallel.h"
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A simple timer utility.
+class Timer {
+public:
+    void Start() { m_StartTime = std::chrono::high_resolution_clock::now(); }
+    double Stop() {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(endTime - m_StartTime).count();
+    }
+private:
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_StartTime;
+};
+
+namespace {
+
+// Every message starts with this header, followed by `count` 64-bit words.
+enum class ShardMessage : uint32_t {
+    LAYOUT = 1, // ringDim, numTowers, firstWord, endWord, q_0 .. q_{T-1}
+    ADD = 2,    // The shard's slice of one polynomial of chunk `chunk`.
+    RESULT = 3, // Request; the reply is a ResultHeader and the slice sum.
+    RESET = 4,
+    STOP = 5
+};
+
+struct MessageHeader {
+    ShardMessage type;
+    uint32_t chunk;
+    uint64_t count;
+};
+
+struct ResultHeader {
+    uint64_t count;
+    double foldMs; // The shard's summing time since the last reset.
+};
+
+void WriteAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        // MSG_NOSIGNAL: a dead shard must raise an error, not SIGPIPE.
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) throw std::runtime_error("Failed to write to an aggregator shard socket");
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+bool ReadAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void SendMessage(int fd, ShardMessage type, uint32_t chunk, const uint64_t* words, uint64_t count) {
+    MessageHeader header{type, chunk, count};
+    WriteAll(fd, &header, sizeof(header));
+    if (count > 0) WriteAll(fd, words, count * sizeof(uint64_t));
+}
+
+// The shard process: sums its slice of every polynomial it is sent.
+void RunShard(int fd) {
+    uint64_t ringDim = 0, firstWord = 0, endWord = 0;
+    std::vector<uint64_t> moduli;
+    std::map<uint32_t, std::vector<uint64_t>> sums; // Per chunk.
+    std::vector<uint64_t> buffer;
+    double foldMs = 0.0;
+    Timer timer;
+
+    MessageHeader header;
+    while (ReadAll(fd, &header, sizeof(header))) {
+        buffer.resize(header.count);
+        if (header.count > 0 && !ReadAll(fd, buffer.data(), header.count * sizeof(uint64_t))) return;
+
+        switch (header.type) {
+        case ShardMessage::LAYOUT:
+            ringDim = buffer[0];
+            firstWord = buffer[2];
+            endWord = buffer[3];
+            moduli.assign(buffer.begin() + 4, buffer.begin() + 4 + buffer[1]);
+            sums.clear();
+            break;
+        case ShardMessage::ADD: {
+            timer.Start();
+            std::vector<uint64_t>& sum = sums[header.chunk];
+            if (sum.empty()) {
+                sum = buffer;
+            } else {
+                // Walk the slice one tower segment at a time, so q is fixed per inner loop.
+                for (uint64_t w = firstWord; w < endWord;) {
+                    const uint64_t q = moduli[w / ringDim];
+                    const uint64_t segmentEnd = std::min(endWord, (w / ringDim + 1) * ringDim);
+                    for (; w < segmentEnd; ++w) {
+                        uint64_t x = sum[w - firstWord] + buffer[w - firstWord];
+                        sum[w - firstWord] = (x >= q) ? x - q : x;
+                    }
+                }
+            }
+            foldMs += timer.Stop();
+            break;
+        }
+        case ShardMessage::RESULT: {
+            std::vector<uint64_t>& sum = sums[header.chunk];
+            sum.resize(endWord - firstWord, 0);
+            ResultHeader reply{sum.size(), foldMs};
+            WriteAll(fd, &reply, sizeof(reply));
+            WriteAll(fd, sum.data(), sum.size() * sizeof(uint64_t));
+            break;
+        }
+        case ShardMessage::RESET:
+            sums.clear();
+            foldMs = 0.0;
+            break;
+        case ShardMessage::STOP:
+            return;
+        }
+    }
+}
+
+} // namespace
+
+ShardedServer::ShardedServer(uint32_t numShards, uint32_t numChunks)
+    : m_numChunks(numChunks), m_numShares(numChunks, 0) {
+    if (numShards == 0 || numChunks == 0) {
+        throw std::invalid_argument("A sharded server needs at least one shard and one chunk");
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    try {
+        startShards(numShards);
+    } catch (...) {
+        // The destructor will not run: stop and reap the shards already started.
+        stopShards();
+        throw;
+    }
+}
+
+ShardedServer::~ShardedServer() {
+    stopShards();
+}
+
+void ShardedServer::startShards(uint32_t numShards) {
+    m_shards.reserve(numShards); // push_back must not throw once a shard is forked.
+    for (uint32_t k = 0; k < numShards; ++k) {
+        auto shard = std::make_unique<Shard>();
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            throw std::runtime_error("Failed to create an aggregator shard socket");
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            throw std::runtime_error("Failed to fork an aggregator shard");
+        }
+        if (pid == 0) {
+            // Shard: keep only its own end of its own socket.
+            close(fds[0]);
+            for (const auto& other : m_shards) close(other->fd);
+            int status = 0;
+            try {
+                RunShard(fds[1]);
+            } catch (const std::exception& e) {
+                std::cerr << "Aggregator shard " << k << " failed: " << e.what() << std::endl;
+                status = 1;
+            }
+            close(fds[1]);
+            _exit(status);
+        }
+        close(fds[1]);
+        shard->pid = pid;
+        shard->fd = fds[0];
+        m_shards.push_back(std::move(shard));
+    }
+}
+
+void ShardedServer::stopShards() {
+    for (auto& shard : m_shards) {
+        try {
+            SendMessage(shard->fd, ShardMessage::STOP, 0, nullptr, 0);
+        } catch (const std::exception&) {
+            // Already gone; reaped below.
+        }
+        close(shard->fd);
+        int status = 0;
+        waitpid(shard->pid, &status, 0);
+    }
+    m_shards.clear();
+}
+
+void ShardedServer::configure(const DCRTPoly& poly) {
+    m_params = poly.GetParams();
+    m_ringDim = poly.GetRingDimension();
+    m_numTowers = poly.GetNumOfElements();
+    const uint64_t totalWords = static_cast<uint64_t>(m_ringDim) * m_numTowers;
+    const uint64_t numShards = m_shards.size();
+
+    for (uint64_t k = 0; k < numShards; ++k) {
+        Shard& shard = *m_shards[k];
+        shard.stats.firstWord = totalWords * k / numShards;
+        shard.stats.endWord = totalWords * (k + 1) / numShards;
+        shard.stats.accumulatorBytes = (shard.stats.endWord - shard.stats.firstWord) * sizeof(uint64_t) * m_numChunks;
+
+        std::vector<uint64_t> layout = {m_ringDim, m_numTowers, shard.stats.firstWord, shard.stats.endWord};
+        for (uint32_t i = 0; i < m_numTowers; ++i) {
+            layout.push_back(poly.GetElementAtIndex(i).GetModulus().ConvertToInt());
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SendMessage(shard.fd, ShardMessage::LAYOUT, 0, layout.data(), layout.size());
+    }
+    m_configured = true;
+}
+
+void ShardedServer::sendSlices(const DCRTPoly& poly, uint32_t chunk) {
+    if (poly.GetNumOfElements() != m_numTowers || poly.GetRingDimension() != m_ringDim) {
+        throw std::runtime_error("Share does not match the sharded server's layout (" +
+                                 std::to_string(m_numTowers) + " towers of N=" + std::to_string(m_ringDim) + ")");
+    }
+    std::vector<uint64_t> slice;
+    for (auto& shardPtr : m_shards) {
+        Shard& shard = *shardPtr;
+        const uint64_t first = shard.stats.firstWord, end = shard.stats.endWord;
+        slice.resize(end - first);
+        for (uint64_t w = first; w < end;) {
+            const NativePoly& tower = poly.GetElementAtIndex(static_cast<uint32_t>(w / m_ringDim));
+            const uint64_t segmentEnd = std::min(end, (w / m_ringDim + 1) * m_ringDim);
+            for (; w < segmentEnd; ++w) {
+                slice[w - first] = tower[w % m_ringDim].ConvertToInt();
+            }
+        }
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        SendMessage(shard.fd, ShardMessage::ADD, chunk, slice.data(), slice.size());
+        shard.stats.bytesReceived += slice.size() * sizeof(uint64_t);
+    }
+}
+
+void ShardedServer::collectShare(const ClientShare& share) {
+    if (share.chunkIndex >= m_numChunks) {
+        throw std::out_of_range("Share for chunk " + std::to_string(share.chunkIndex) +
+                                " but the server aggregates " + std::to_string(m_numChunks));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        if (!m_configured) configure(share.c0);
+    }
+    // As in Server: both components go into the same sum. A COMPACT share is one polynomial.
+    sendSlices(share.c0, share.chunkIndex);
+    if (share.format == ShareFormat::SPLIT) {
+        sendSlices(share.d_masked, share.chunkIndex);
+    }
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    ++m_numShares[share.chunkIndex];
+}
+
+ServerResult ShardedServer::getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize, SlotPacking packing) {
+    if (!m_configured || getNumShares() == 0) {
+        throw std::runtime_error("No client shares to aggregate.");
+    }
+    ServerResult result;
+    Timer timer;
+
+    // --- 1. Gather every shard's slice sums and stitch them into one polynomial per chunk ---
+    timer.Start();
+    std::vector<DCRTPoly> finalPolys(m_numChunks);
+    double shardFoldMs = 0.0;
+    std::vector<uint64_t> slice;
+    for (uint32_t c = 0; c < m_numChunks; ++c) {
+        finalPolys[c] = DCRTPoly(m_params, Format::EVALUATION, true);
+        for (auto& shardPtr : m_shards) {
+            Shard& shard = *shardPtr;
+            ResultHeader reply;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                SendMessage(shard.fd, ShardMessage::RESULT, c, nullptr, 0);
+                slice.resize(shard.stats.endWord - shard.stats.firstWord);
+                if (!ReadAll(shard.fd, &reply, sizeof(reply)) || reply.count != slice.size() ||
+                    !ReadAll(shard.fd, slice.data(), slice.size() * sizeof(uint64_t))) {
+                    throw std::runtime_error("Aggregator shard did not return its sums");
+                }
+            }
+            // Every shard reports its total time; count it once.
+            if (c == 0) shardFoldMs += reply.foldMs;
+            for (uint64_t w = shard.stats.firstWord; w < shard.stats.endWord; ++w) {
+                finalPolys[c].ElementAtIndex(static_cast<uint32_t>(w / m_ringDim))[w % m_ringDim] =
+                    NativeInteger(slice[w - shard.stats.firstWord]);
+            }
+        }
+    }
+    result.timings.t_aggregate_ms = timer.Stop() + shardFoldMs;
+
+    // --- 2. Decode every chunk into its slice of the result ---
+    const uint32_t capacity = ChunkCapacity(cc, packing);
+    result.final_aggregated_vector.assign(dataSize, 0.0);
+    timer.Start();
+    ParallelFor(static_cast<int>(m_numChunks), ResolveThreadCount(0), [&](int c) {
+        const uint32_t begin = std::min(dataSize, c * capacity);
+        const uint32_t length = std::min(capacity, dataSize - begin);
+        std::vector<double> values = Decode(finalPolys[c], cc, length, packing);
+        std::copy(values.begin(), values.end(), result.final_aggregated_vector.begin() + begin);
+    });
+    result.timings.t_decode_ms = timer.Stop();
+    return result;
+}
+
+void ShardedServer::reset() {
+    for (auto& shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        SendMessage(shard->fd, ShardMessage::RESET, 0, nullptr, 0);
+        shard->stats.bytesReceived = 0;
+    }
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    std::fill(m_numShares.begin(), m_numShares.end(), 0);
+}
+
+size_t ShardedServer::getNumShares() const {
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    return *std::min_element(m_numShares.begin(), m_numShares.end());
+}
+
+uint32_t ShardedServer::getNumShards() const {
+    return static_cast<uint32_t>(m_shards.size());
+}
+
+std::vector<ShardStats> ShardedServer::getShardStats() const {
+    std::vector<ShardStats> stats;
+    for (const auto& shard : m_shards) {
+        stats.push_back(shard->stats);
+    }
+    return stats;
+}
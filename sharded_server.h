@@ -0,0 +1,83 @@
+// sharded_server.h
+//
+// Header file for the sharded aggregation server. Addition acts on every
+// coefficient of every RNS tower independently, so the words of a share can
+// be split across aggregator processes that each sum only their slice. A
+// coordinator routes the slices over Unix sockets and stitches the slice sums
+// back into one polynomial per chunk before decoding.
+
+#ifndef SHARDED_SERVER_H
+#define SHARDED_SERVER_H
+
+#include "common.h"
+#include <mutex>
+#include <sys/types.h>
+
+// What one shard held and received during a round.
+struct ShardStats {
+    uint64_t firstWord{0};       // Slice [firstWord, endWord) of the tower-major word layout.
+    uint64_t endWord{0};
+    size_t accumulatorBytes{0};  // Running sums held by the shard (all chunks).
+    size_t bytesReceived{0};     // Share payload routed to the shard.
+};
+
+class ShardedServer {
+public:
+    // Forks numShards aggregator processes, each connected to the coordinator
+    // by a Unix socket pair. Shares are laid out tower-major (tower i's N words,
+    // then tower i+1's) and the T*N words are split into numShards contiguous
+    // slices: with T a multiple of numShards every shard owns whole towers,
+    // otherwise slices are coefficient ranges. Throws std::runtime_error if a
+    // shard cannot be started.
+    explicit ShardedServer(uint32_t numShards, uint32_t numChunks = 1);
+    // Stops and reaps every shard process.
+    ~ShardedServer();
+    ShardedServer(const ShardedServer&) = delete;
+    ShardedServer& operator=(const ShardedServer&) = delete;
+
+    // Sends each shard its slice of the share. Safe to call concurrently. The
+    // first share fixes the layout (ring dimension, towers, moduli); later
+    // shares must match it.
+    void collectShare(const ClientShare& share);
+
+    // Collects every shard's slice sums, stitches them into one polynomial per
+    // chunk and decodes, like Server::getFinalResult. t_aggregate_ms is the
+    // shards' summing time plus the gather and stitch on the coordinator.
+    ServerResult getFinalResult(CryptoContext<DCRTPoly>& cc, uint32_t dataSize,
+                                SlotPacking packing = SlotPacking::REAL);
+
+    // Clears the shards' sums for the next round (the layout is kept).
+    void reset();
+
+    size_t getNumShares() const;
+    uint32_t getNumShards() const;
+    std::vector<ShardStats> getShardStats() const;
+
+private:
+    struct Shard {
+        pid_t pid{-1};
+        int fd{-1};
+        std::mutex mutex; // Serializes messages on the socket.
+        ShardStats stats;
+    };
+
+    // Forks the shards; on failure the ones already started stay in m_shards.
+    void startShards(uint32_t numShards);
+    // Sends STOP to every shard, closes its socket and reaps it.
+    void stopShards();
+    // Sends the layout to every shard. Caller holds m_layoutMutex.
+    void configure(const DCRTPoly& poly);
+    void sendSlices(const DCRTPoly& poly, uint32_t chunk);
+
+    uint32_t m_numChunks;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    mutable std::mutex m_layoutMutex;
+    bool m_configured{false};
+    std::shared_ptr<DCRTPoly::Params> m_params; // Towers of the shares (after any reduction).
+    uint32_t m_ringDim{0};
+    uint32_t m_numTowers{0};
+    std::vector<size_t> m_numShares; // Per chunk.
+};
+
+#endif // SHARDED_SERVER_H
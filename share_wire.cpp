@@ -0,0 +1,313 @@
+// share_wire.cpp
+//
+// Implementation of the flat share wire format: serialization, in-place
+// validation and aggregation, rebuilding DCRTPolys, and read-only file mapping.
+
+#include "share_wire.h"
+#include "pack_kernels.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Coefficient arrays are read in place as uint64_t, which is only the wire's
+// little-endian layout on a little-endian host.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The share wire format is read in place and requires a little-endian host"
+#endif
+
+namespace {
+
+constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+uint64_t Fnv1a(uint64_t hash, uint64_t word) {
+    for (int b = 0; b < 8; ++b) {
+        hash ^= (word >> (8 * b)) & 0xFF;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t NumPolys(ShareFormat format) {
+    return format == ShareFormat::SPLIT ? 2 : 1;
+}
+
+// Bytes of the PACKED width table: one byte per tower, padded to whole words.
+size_t WidthTableBytes(uint32_t numTowers) {
+    return (static_cast<size_t>(numTowers) + 7) / 8 * 8;
+}
+
+size_t TowerWords(uint32_t ringDim, uint32_t width, ShareEncoding encoding) {
+    return encoding == ShareEncoding::PACKED ? PackedWords(ringDim, width) : ringDim;
+}
+
+// a * b + c, or false if that overflows size_t (sizes built from untrusted headers).
+bool MulAdd(size_t a, size_t b, size_t c, size_t& out) {
+    return !__builtin_mul_overflow(a, b, &out) && !__builtin_add_overflow(out, c, &out);
+}
+
+size_t PolyWords(const DCRTPoly& poly, ShareEncoding encoding) {
+    size_t words = 0;
+    for (uint32_t i = 0; i < poly.GetNumOfElements(); ++i) {
+        const uint64_t q = poly.GetElementAtIndex(i).GetModulus().ConvertToInt();
+        words += TowerWords(poly.GetRingDimension(), PackedWidth(q), encoding);
+    }
+    return words;
+}
+
+} // namespace
+
+uint64_t WireContextId(const CryptoContext<DCRTPoly>& cc) {
+    auto params = cc->GetCryptoParameters()->GetElementParams();
+    uint64_t hash = Fnv1a(FNV_OFFSET, params->GetRingDimension());
+    for (const auto& tower : params->GetParams()) {
+        hash = Fnv1a(hash, tower->GetModulus().ConvertToInt());
+    }
+    return hash;
+}
+
+uint64_t ModuliFingerprint(const DCRTPoly& poly) {
+    uint64_t hash = FNV_OFFSET;
+    for (uint32_t i = 0; i < poly.GetNumOfElements(); ++i) {
+        hash = Fnv1a(hash, poly.GetElementAtIndex(i).GetModulus().ConvertToInt());
+    }
+    return hash;
+}
+
+size_t ShareWireSize(const ClientShare& share, ShareEncoding encoding) {
+    size_t bytes = sizeof(ShareWireHeader) + NumPolys(share.format) * PolyWords(share.c0, encoding) * sizeof(uint64_t);
+    if (encoding == ShareEncoding::PACKED) bytes += WidthTableBytes(share.c0.GetNumOfElements());
+    return bytes;
+}
+
+void SerializeShareWire(const ClientShare& share, uint64_t contextId, std::vector<uint8_t>& out,
+                        ShareEncoding encoding) {
+    ShareWireHeader header{};
+    header.magic = SHARE_WIRE_MAGIC;
+    header.version = SHARE_WIRE_VERSION;
+    header.format = static_cast<uint8_t>(share.format);
+    header.numPolys = static_cast<uint8_t>(NumPolys(share.format));
+    header.chunkIndex = share.chunkIndex;
+    header.ringDim = share.c0.GetRingDimension();
+    header.numTowers = share.c0.GetNumOfElements();
+    header.encoding = static_cast<uint8_t>(encoding);
+    header.contextId = contextId;
+    header.moduliFingerprint = ModuliFingerprint(share.c0);
+
+    out.assign(ShareWireSize(share, encoding), 0);
+    std::memcpy(out.data(), &header, sizeof(header));
+    uint8_t* widths = out.data() + sizeof(header);
+    uint64_t* words = reinterpret_cast<uint64_t*>(widths);
+    if (encoding == ShareEncoding::PACKED) {
+        for (uint32_t i = 0; i < header.numTowers; ++i) {
+            widths[i] = static_cast<uint8_t>(PackedWidth(share.c0.GetElementAtIndex(i).GetModulus().ConvertToInt()));
+        }
+        words = reinterpret_cast<uint64_t*>(widths + WidthTableBytes(header.numTowers));
+    }
+
+    std::vector<uint64_t> coefficients(encoding == ShareEncoding::PACKED ? header.ringDim : 0);
+    const DCRTPoly* polys[2] = {&share.c0, &share.d_masked};
+    for (uint32_t p = 0; p < header.numPolys; ++p) {
+        if (polys[p]->GetNumOfElements() != header.numTowers) {
+            throw std::runtime_error("Share polynomials have different tower counts");
+        }
+        for (uint32_t i = 0; i < header.numTowers; ++i) {
+            const NativePoly& tower = polys[p]->GetElementAtIndex(i);
+            if (encoding == ShareEncoding::RAW64) {
+                for (uint32_t j = 0; j < header.ringDim; ++j) {
+                    *words++ = tower[j].ConvertToInt();
+                }
+                continue;
+            }
+            for (uint32_t j = 0; j < header.ringDim; ++j) {
+                coefficients[j] = tower[j].ConvertToInt();
+            }
+            PackBits(coefficients.data(), header.ringDim, widths[i], words);
+            words += PackedWords(header.ringDim, widths[i]);
+        }
+    }
+}
+
+ShareWireView::ShareWireView(const void* data, size_t bytes)
+    : m_header(static_cast<const ShareWireHeader*>(data)),
+      m_words(reinterpret_cast<const uint64_t*>(static_cast<const uint8_t*>(data) + sizeof(ShareWireHeader))) {
+    if (bytes < sizeof(ShareWireHeader) || reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) != 0) {
+        throw std::runtime_error("Share buffer is truncated or misaligned");
+    }
+    if (m_header->magic != SHARE_WIRE_MAGIC || m_header->version != SHARE_WIRE_VERSION) {
+        throw std::runtime_error("Not a share in wire format version " + std::to_string(SHARE_WIRE_VERSION));
+    }
+    const uint32_t expectedPolys = NumPolys(static_cast<ShareFormat>(m_header->format));
+    if (m_header->format > static_cast<uint8_t>(ShareFormat::COMPACT) || m_header->numPolys != expectedPolys ||
+        m_header->encoding > static_cast<uint8_t>(ShareEncoding::PACKED)) {
+        throw std::runtime_error("Malformed share header");
+    }
+
+    // Every tower takes at least one byte (its width, or its coefficients), so
+    // this bounds the loops below by the buffer rather than by the header.
+    if (m_header->ringDim == 0 || m_header->numTowers > bytes) {
+        throw std::runtime_error("Malformed share: header does not match its " + std::to_string(bytes) + " bytes");
+    }
+
+    size_t expected = sizeof(ShareWireHeader);
+    if (encoding() == ShareEncoding::RAW64) {
+        if (__builtin_mul_overflow(static_cast<size_t>(m_header->numTowers), m_header->ringDim, &m_polyWords)) {
+            throw std::runtime_error("Malformed share: size overflows");
+        }
+    } else {
+        expected += WidthTableBytes(m_header->numTowers);
+        if (bytes < expected) throw std::runtime_error("Share buffer is truncated");
+        m_widths = static_cast<const uint8_t*>(data) + sizeof(ShareWireHeader);
+        m_words = reinterpret_cast<const uint64_t*>(m_widths + WidthTableBytes(m_header->numTowers));
+        for (uint32_t i = 0; i < m_header->numTowers; ++i) {
+            if (width(i) == 0 || width(i) > 64) throw std::runtime_error("Malformed share: bad coefficient width");
+            if (__builtin_add_overflow(m_polyWords, PackedWords(m_header->ringDim, width(i)), &m_polyWords)) {
+                throw std::runtime_error("Malformed share: size overflows");
+            }
+        }
+    }
+    if (!MulAdd(m_header->numPolys * sizeof(uint64_t), m_polyWords, expected, expected) || bytes != expected) {
+        throw std::runtime_error("Malformed share: header does not match its " + std::to_string(bytes) + " bytes");
+    }
+}
+
+uint32_t ShareWireView::width(uint32_t tower) const {
+    return m_widths ? m_widths[tower] : 64;
+}
+
+const uint64_t* ShareWireView::tower(uint32_t poly, uint32_t tower) const {
+    if (!m_widths) {
+        return m_words + (static_cast<size_t>(poly) * m_header->numTowers + tower) * m_header->ringDim;
+    }
+    size_t offset = poly * m_polyWords;
+    for (uint32_t i = 0; i < tower; ++i) {
+        offset += PackedWords(m_header->ringDim, m_widths[i]);
+    }
+    return m_words + offset;
+}
+
+const uint64_t* ShareWireView::coefficients(uint32_t poly, uint32_t tower, uint64_t* scratch) const {
+    if (!m_widths) return this->tower(poly, tower);
+    UnpackBits(this->tower(poly, tower), m_header->ringDim, m_widths[tower], scratch);
+    return scratch;
+}
+
+void ShareWireView::expectContext(uint64_t contextId) const {
+    if (m_header->contextId != contextId) {
+        throw std::runtime_error("Share was encrypted under a different CryptoContext");
+    }
+}
+
+namespace {
+
+// A PACKED share must store tower i at exactly PackedWidth(q_i) bits of the
+// receiver's moduli; any other width would unpack into the wrong coefficients.
+void ExpectWidths(const ShareWireView& view, const DCRTPoly& poly) {
+    if (view.encoding() != ShareEncoding::PACKED) return;
+    for (uint32_t i = 0; i < view.header().numTowers; ++i) {
+        if (view.width(i) != PackedWidth(poly.GetElementAtIndex(i).GetModulus().ConvertToInt())) {
+            throw std::runtime_error("Share tower " + std::to_string(i) + " is packed at " +
+                                     std::to_string(view.width(i)) + " bits, which does not fit its modulus");
+        }
+    }
+}
+
+} // namespace
+
+ClientShare DeserializeShareWire(const ShareWireView& view, const std::shared_ptr<DCRTPoly::Params>& contextParams) {
+    const ShareWireHeader& header = view.header();
+    const uint32_t contextTowers = static_cast<uint32_t>(contextParams->GetParams().size());
+    if (header.numTowers == 0 || header.numTowers > contextTowers) {
+        throw std::runtime_error("Share has " + std::to_string(header.numTowers) + " towers but the context has " +
+                                 std::to_string(contextTowers));
+    }
+
+    std::vector<uint64_t> scratch(view.encoding() == ShareEncoding::PACKED ? header.ringDim : 0);
+    ClientShare share;
+    share.format = static_cast<ShareFormat>(header.format);
+    share.chunkIndex = header.chunkIndex;
+    DCRTPoly* polys[2] = {&share.c0, &share.d_masked};
+    for (uint32_t p = 0; p < header.numPolys; ++p) {
+        DCRTPoly& poly = *polys[p];
+        poly = DCRTPoly(contextParams, Format::EVALUATION, true);
+        poly.DropLastElements(contextTowers - header.numTowers);
+        if (p == 0 && (poly.GetRingDimension() != header.ringDim ||
+                       ModuliFingerprint(poly) != header.moduliFingerprint)) {
+            throw std::runtime_error("Share moduli do not match the receiver's context");
+        }
+        if (p == 0) ExpectWidths(view, poly);
+        for (uint32_t i = 0; i < header.numTowers; ++i) {
+            NativePoly& tower = poly.ElementAtIndex(i);
+            const uint64_t q = tower.GetModulus().ConvertToInt();
+            const uint64_t* words = view.coefficients(p, i, scratch.data());
+            for (uint32_t j = 0; j < header.ringDim; ++j) {
+                if (words[j] >= q) throw std::runtime_error("Malformed share: coefficient not reduced mod q");
+                tower[j] = NativeInteger(words[j]);
+            }
+        }
+    }
+    return share;
+}
+
+void AccumulateShareWire(const ShareWireView& view, DCRTPoly& accumulator) {
+    const ShareWireHeader& header = view.header();
+    if (accumulator.GetNumOfElements() != header.numTowers || accumulator.GetRingDimension() != header.ringDim ||
+        ModuliFingerprint(accumulator) != header.moduliFingerprint) {
+        throw std::runtime_error("Share towers do not match the accumulator");
+    }
+    ExpectWidths(view, accumulator);
+    // Unpacked towers of a PACKED share; reused across shares on this thread.
+    thread_local std::vector<uint64_t> scratch;
+    if (view.encoding() == ShareEncoding::PACKED) scratch.resize(2 * static_cast<size_t>(header.ringDim));
+    for (uint32_t i = 0; i < header.numTowers; ++i) {
+        NativePoly& tower = accumulator.ElementAtIndex(i);
+        const uint64_t q = tower.GetModulus().ConvertToInt();
+        const uint64_t* c0 = view.coefficients(0, i, scratch.data());
+        const uint64_t* d = header.numPolys > 1 ? view.coefficients(1, i, scratch.data() + header.ringDim) : nullptr;
+        for (uint32_t j = 0; j < header.ringDim; ++j) {
+            // A well-formed share is reduced, so the % never runs; it keeps a
+            // malformed one from wrapping the add or leaving a value >= q.
+            uint64_t a = c0[j];
+            if (a >= q) a %= q;
+            uint64_t x = tower[j].ConvertToInt() + a;
+            if (x >= q) x -= q;
+            if (d) {
+                uint64_t b = d[j];
+                if (b >= q) b %= q;
+                x += b;
+                if (x >= q) x -= q;
+            }
+            tower[j] = NativeInteger(x);
+        }
+    }
+}
+
+MappedShareWire::MappedShareWire(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open share file: " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        throw std::runtime_error("Share file is empty: " + path);
+    }
+    m_bytes = static_cast<size_t>(st.st_size);
+    m_mapping = ::mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the file contents reachable.
+    if (m_mapping == MAP_FAILED) {
+        m_mapping = nullptr;
+        throw std::runtime_error("Failed to mmap share file: " + path);
+    }
+    try {
+        m_view = std::make_unique<ShareWireView>(m_mapping, m_bytes);
+    } catch (...) {
+        ::munmap(m_mapping, m_bytes);
+        throw;
+    }
+}
+
+MappedShareWire::~MappedShareWire() {
+    if (m_mapping) ::munmap(m_mapping, m_bytes);
+}
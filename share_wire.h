@@ -0,0 +1,117 @@
+// share_wire.h
+//
+// Header file for the flat share wire format. lbcrypto::Serial (cereal) writes
+// per-object metadata around every tower and must rebuild a DCRTPoly on the
+// receiving side. The wire format is a fixed header followed by the raw
+// coefficient words, so a receiver can validate a share with a few compares
+// and then read, or sum, the coefficients in place: from its receive buffer
+// or from a memory-mapped file.
+
+#ifndef SHARE_WIRE_H
+#define SHARE_WIRE_H
+
+#include "common.h"
+#include <string>
+
+// How the coefficient arrays are stored.
+enum class ShareEncoding : uint8_t {
+    RAW64,  // One uint64 per coefficient.
+    PACKED  // Tower i's coefficients at ceil(log2 q_i) bits each (pack_kernels.h).
+};
+
+// Layout (little-endian): this 40-byte header, then `numPolys` polynomials
+// (c0, then d_masked for a SPLIT share), each `numTowers` contiguous arrays of
+// `ringDim` coefficients in EVALUATION form. RAW64 arrays hold one uint64 per
+// coefficient. A PACKED share has a table of one bit width per tower (padded
+// to 8 bytes) after the header, and each array is PackedWords(ringDim, width)
+// words of PackBits output. The arrays start 8-byte aligned whenever the
+// buffer does.
+struct ShareWireHeader {
+    uint32_t magic;             // SHARE_WIRE_MAGIC ("SFSW").
+    uint16_t version;           // SHARE_WIRE_VERSION.
+    uint8_t format;             // ShareFormat of the share.
+    uint8_t numPolys;           // 2 for SPLIT, 1 for COMPACT.
+    uint32_t chunkIndex;
+    uint32_t ringDim;
+    uint32_t numTowers;         // Towers uploaded (after any reduction).
+    uint8_t encoding;           // ShareEncoding.
+    uint8_t reserved[3];
+    uint64_t contextId;         // WireContextId of the sender's CryptoContext.
+    uint64_t moduliFingerprint; // ModuliFingerprint of the uploaded towers.
+};
+static_assert(sizeof(ShareWireHeader) == 40, "ShareWireHeader must stay 40 bytes");
+
+constexpr uint32_t SHARE_WIRE_MAGIC = 0x57534653; // "SFSW" in little-endian byte order.
+constexpr uint16_t SHARE_WIRE_VERSION = 2;
+
+// Identifies a CryptoContext by its ring dimension and full modulus chain, so
+// a receiver can reject shares from a different context.
+uint64_t WireContextId(const CryptoContext<DCRTPoly>& cc);
+// FNV-1a hash of the tower moduli of `poly`.
+uint64_t ModuliFingerprint(const DCRTPoly& poly);
+
+// Bytes of `share` on the wire.
+size_t ShareWireSize(const ClientShare& share, ShareEncoding encoding = ShareEncoding::RAW64);
+
+// Writes `share` (polynomials in EVALUATION form) into `out`, resized to ShareWireSize(share, encoding).
+void SerializeShareWire(const ClientShare& share, uint64_t contextId, std::vector<uint8_t>& out,
+                        ShareEncoding encoding = ShareEncoding::RAW64);
+
+// A validated, read-only view of one serialized share. Does not copy or own
+// the buffer, which must outlive the view and be 8-byte aligned.
+class ShareWireView {
+public:
+    // Throws std::runtime_error if the buffer is not a well-formed share.
+    ShareWireView(const void* data, size_t bytes);
+
+    const ShareWireHeader& header() const { return *m_header; }
+    ShareEncoding encoding() const { return static_cast<ShareEncoding>(m_header->encoding); }
+    // Bits per coefficient of tower `tower` (64 when RAW64).
+    uint32_t width(uint32_t tower) const;
+    // Stored words of tower `tower` of polynomial `poly` (0 = c0, 1 = d_masked):
+    // the coefficients themselves when RAW64, PackBits output when PACKED.
+    const uint64_t* tower(uint32_t poly, uint32_t tower) const;
+    // The coefficients of that tower: the stored words when RAW64, or unpacked
+    // into `scratch` (ringDim words) when PACKED.
+    const uint64_t* coefficients(uint32_t poly, uint32_t tower, uint64_t* scratch) const;
+    // Throws std::runtime_error unless the share came from the context `contextId`.
+    void expectContext(uint64_t contextId) const;
+
+private:
+    const ShareWireHeader* m_header;
+    const uint8_t* m_widths{nullptr}; // PACKED only.
+    const uint64_t* m_words;
+    size_t m_polyWords{0};
+};
+
+// Rebuilds the share as DCRTPolys. `contextParams` are the element parameters
+// of the receiver's context; the towers the share did not upload are dropped.
+// Throws std::runtime_error if the share's moduli differ from the context's or
+// a coefficient is not below its tower's modulus, or if a PACKED share's
+// widths are not PackedWidth() of those moduli.
+ClientShare DeserializeShareWire(const ShareWireView& view, const std::shared_ptr<DCRTPoly::Params>& contextParams);
+
+// Adds every polynomial of the share straight from the buffer (a PACKED share
+// is unpacked one tower at a time) into `accumulator`, which must have the
+// share's towers (EVALUATION form) and, for a PACKED share, their
+// PackedWidth() widths; throws std::runtime_error otherwise. Coefficients of a malformed share that
+// are not below their modulus are reduced, so the accumulator stays in range.
+void AccumulateShareWire(const ShareWireView& view, DCRTPoly& accumulator);
+
+// A share file mapped read-only; the mapping lives as long as the object.
+class MappedShareWire {
+public:
+    explicit MappedShareWire(const std::string& path);
+    ~MappedShareWire();
+    MappedShareWire(const MappedShareWire&) = delete;
+    MappedShareWire& operator=(const MappedShareWire&) = delete;
+
+    const ShareWireView& view() const { return *m_view; }
+
+private:
+    void* m_mapping{nullptr};
+    size_t m_bytes{0};
+    std::unique_ptr<ShareWireView> m_view;
+};
+
+#endif // SHARE_WIRE_H